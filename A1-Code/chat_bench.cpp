@@ -0,0 +1,452 @@
+// Load generator for server_grp.
+//
+// Opens N authenticated connections on loopback, puts each into one of a few
+// benchmark groups, then sends a paced mix of /broadcast, /msg and /group_msg
+// commands for a fixed duration. Every payload carries its scheduled send
+// time, not the time it was written, so each delivered copy yields one
+// end-to-end latency sample that includes any time the generator fell behind
+// (no coordinated omission).
+//
+//   ./chat_bench --clients=500 --rate=2000 --duration=10 --mix=1:8:1
+//
+// Credentials are read from a users file (username:password per line) and
+// assigned round-robin. ./chat_bench --gen-users=N prints N benchmark users to
+// append to the server's users.txt.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "chat_client.h"
+#include "framing.h"
+#include "histogram.h"
+
+#define READ_CHUNK 65536
+#define MAX_EVENTS 256
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 12345;
+    std::string users_file = "users.txt";
+    int clients = 200;
+    int threads = 1;
+    int groups = 4;
+    double rate = 1000;      // commands per second across all connections
+    double duration = 5;     // seconds of load
+    double grace = 2;        // seconds to wait for in-flight deliveries
+    int mix[3] = {1, 8, 1};  // broadcast : private : group
+    FrameMode mode = FrameMode::Length;  // Binary with --protocol=binary
+    bool compress = false;               // binary mode: negotiate compression
+    size_t payload = 0;                  // pad messages to this many bytes of text
+};
+
+enum class BenchState { Greeting, Auth, Joining, Ready, Failed };
+
+struct BenchConn {
+    int fd = -1;
+    int index = 0;
+    BenchState state = BenchState::Greeting;
+    size_t greeting_left = GREETING.size();
+    InputBuffer in;
+    FrameParser parser;
+    std::string out;
+    std::string username;
+    std::string group;
+    uint32_t group_id = UINT32_MAX;  // binary mode, once the server names it
+};
+
+// Per-thread results, merged at the end.
+struct Stats {
+    uint64_t sent[3] = {0, 0, 0};
+    uint64_t delivered[3] = {0, 0, 0};
+    uint64_t errors = 0;
+    uint64_t connect_failures = 0;
+    uint64_t bytes_received = 0;
+    Histogram latency_ns;
+};
+
+constexpr const char *KIND_NAMES[3] = {"broadcast", "private", "group"};
+constexpr char KIND_TAGS[3] = {'B', 'P', 'G'};
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Writes as much of conn.out as the socket takes; the rest waits for EPOLLOUT.
+bool flush_out(BenchConn &conn) {
+    while (!conn.out.empty()) {
+        ssize_t n = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.out.erase(0, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void queue_frame(BenchConn &conn, std::string_view payload) {
+    conn.out += encode_frame(conn.parser.mode, payload);
+}
+
+// Pulls "<tag>#T<ns>" off the end of a delivered chat message.
+void record_delivery(std::string_view frame, Stats &stats) {
+    size_t mark = frame.rfind("#T");
+    if (mark == std::string_view::npos || mark == 0) return;
+    int kind = -1;
+    for (int k = 0; k < 3; ++k) {
+        if (frame[mark - 1] == KIND_TAGS[k]) kind = k;
+    }
+    if (kind < 0) return;
+    uint64_t sent_at = std::strtoull(std::string(frame.substr(mark + 2)).c_str(), nullptr, 10);
+    uint64_t now = now_ns();
+    ++stats.delivered[kind];
+    stats.latency_ns.record(now > sent_at ? now - sent_at : 0);
+}
+
+void handle_frame(BenchConn &conn, std::string_view frame, Stats &stats) {
+    thread_local std::string inflated;
+    if (conn.parser.mode == FrameMode::Binary) {
+        BinaryFrame binary;
+        if (!decode_binary(frame, binary)) return;
+        if (binary.op == Opcode::Deflated &&
+            (!inflate_payload(binary.ids[0], binary.text, MAX_FRAME_LIMIT, inflated) ||
+             !decode_binary(inflated, binary))) {
+            return;
+        }
+        if (binary.op == Opcode::GroupName && binary.text == conn.group) conn.group_id = binary.ids[0];
+        if (binary.op == Opcode::UserName || binary.op == Opcode::GroupName) return;
+        frame = binary.text;
+    }
+    switch (conn.state) {
+    case BenchState::Auth:
+        if (frame.starts_with("Welcome")) {
+            // Creating an existing group only earns a harmless error reply.
+            queue_frame(conn, "/create_group " + conn.group);
+            queue_frame(conn, "/join_group " + conn.group);
+            conn.state = BenchState::Joining;
+        } else if (frame.starts_with("Authentication failed") || frame.starts_with("User is already logged in")) {
+            conn.state = BenchState::Failed;
+        }
+        break;
+    case BenchState::Joining:
+        if (frame.starts_with("You joined the group")) conn.state = BenchState::Ready;
+        break;
+    case BenchState::Ready:
+        if (frame.starts_with("ERROR")) {
+            ++stats.errors;
+        } else {
+            record_delivery(frame, stats);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Reads everything available on a connection. Returns false on EOF or error.
+bool read_conn(BenchConn &conn, Stats &stats) {
+    while (true) {
+        char *space = conn.in.write_space(READ_CHUNK);
+        ssize_t n = recv(conn.fd, space, conn.in.writable(), 0);
+        if (n > 0) {
+            conn.in.commit(n);
+            stats.bytes_received += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+
+        if (conn.greeting_left > 0) {
+            size_t skip = std::min(conn.greeting_left, conn.in.readable().size());
+            conn.in.consume(skip);
+            conn.greeting_left -= skip;
+            if (conn.greeting_left == 0) conn.state = BenchState::Auth;
+        }
+        std::string_view frame;
+        while (conn.greeting_left == 0) {
+            ParseResult result = conn.parser.next(conn.in, frame);
+            if (result == ParseResult::NeedMore) break;
+            if (result == ParseResult::Error) return false;
+            handle_frame(conn, frame, stats);
+        }
+    }
+    return true;
+}
+
+int open_connection(const Options &opts) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Chat-like text of roughly `size` bytes that payloads are padded with, so
+// large messages compress about as well as real pastes.
+std::string make_filler(size_t size, std::mt19937 &rng) {
+    static const char *words[] = {"the", "server", "message", "group", "latency", "queue", "buffer", "client",
+                                  "and", "to", "of", "a", "is", "for", "with", "frame", "send", "receive"};
+    std::string text;
+    while (text.size() < size) {
+        text += words[rng() % (sizeof(words) / sizeof(words[0]))];
+        text += ' ';
+    }
+    text.resize(size);
+    return text;
+}
+
+// Runs the event loop until `until` (ns) or, when until is 0, until every
+// connection has left the setup states. Sends paced commands when `send_rate`
+// is positive.
+void run_loop(int epoll_fd, std::vector<BenchConn> &conns, const std::vector<Account> &creds,
+              const Options &opts, Stats &stats, uint64_t until, double send_rate, std::mt19937 &rng) {
+    const std::string filler = make_filler(opts.payload, rng);
+    epoll_event events[MAX_EVENTS];
+    uint64_t interval = send_rate > 0 ? static_cast<uint64_t>(1e9 / send_rate) : 0;
+    uint64_t next_send = now_ns();
+    int mix_total = opts.mix[0] + opts.mix[1] + opts.mix[2];
+
+    while (true) {
+        uint64_t now = now_ns();
+        if (until && now >= until) return;
+        if (!until) {
+            bool settled = true;
+            for (const BenchConn &conn : conns) {
+                if (conn.state != BenchState::Ready && conn.state != BenchState::Failed) settled = false;
+            }
+            if (settled) return;
+        }
+
+        // Send every command that is due; each goes out from a random connection.
+        while (interval && now >= next_send && mix_total > 0 && !conns.empty()) {
+            BenchConn &conn = conns[rng() % conns.size()];
+            uint64_t scheduled = next_send;
+            next_send += interval;
+            if (conn.state != BenchState::Ready) continue;
+            int pick = rng() % mix_total;
+            int kind = pick < opts.mix[0] ? 0 : pick < opts.mix[0] + opts.mix[1] ? 1 : 2;
+            std::string stamp = filler + KIND_TAGS[kind] + "#T" + std::to_string(scheduled);
+            if (kind == 0 && conn.parser.mode == FrameMode::Binary) {
+                conn.out += encode_binary(Opcode::SendBroadcast, {}, stamp);
+            } else if (kind == 2 && conn.group_id != UINT32_MAX) {
+                conn.out += encode_binary(Opcode::SendGroup, {conn.group_id}, stamp);
+            } else if (kind == 0) {
+                queue_frame(conn, "/broadcast " + stamp);
+            } else if (kind == 1) {
+                // Only users that some benchmark connection logged in as.
+                const Account &to = creds[rng() % std::min<size_t>(creds.size(), opts.clients)];
+                queue_frame(conn, "/msg " + to.username + " " + stamp);
+            } else {
+                queue_frame(conn, "/group_msg " + conn.group + " " + stamp);
+            }
+            ++stats.sent[kind];
+            if (!flush_out(conn)) conn.state = BenchState::Failed;
+        }
+
+        int timeout_ms = 100;
+        if (interval) {
+            uint64_t wait = next_send > now ? next_send - now : 0;
+            timeout_ms = static_cast<int>(std::min<uint64_t>(wait / 1000000, 100));
+        }
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            BenchConn &conn = conns[events[i].data.u32];
+            if (conn.state == BenchState::Failed) continue;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ok = read_conn(conn, stats);
+            if (ok) ok = flush_out(conn);
+            if (!ok) {
+                if (conn.state != BenchState::Ready) ++stats.connect_failures;
+                conn.state = BenchState::Failed;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+            }
+        }
+    }
+}
+
+void bench_thread(int thread_index, const Options &opts, const std::vector<Account> &creds,
+                  std::barrier<> &setup_done, std::barrier<> &load_start, Stats &stats) {
+    std::mt19937 rng(thread_index * 7919 + 1);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<BenchConn> conns;
+    for (int i = thread_index; i < opts.clients; i += opts.threads) {
+        BenchConn conn;
+        conn.index = i;
+        const Account &cred = creds[i % creds.size()];
+        conn.username = cred.username;
+        conn.group = "bench" + std::to_string(i % opts.groups);
+        conn.parser.mode = opts.mode;
+        conn.parser.max_frame = MAX_FRAME_LIMIT;
+        conn.fd = open_connection(opts);
+        if (conn.fd < 0) {
+            ++stats.connect_failures;
+            continue;
+        }
+        // Pipeline the whole login; the server parses frames in order.
+        conn.out.assign(opts.mode == FrameMode::Binary ? BINARY_PREAMBLE : PREAMBLE, FRAME_HEADER_SIZE);
+        if (opts.mode == FrameMode::Binary && opts.compress) conn.out[3] |= PREAMBLE_DEFLATE;
+        queue_frame(conn, cred.username);
+        queue_frame(conn, cred.password);
+        conns.push_back(std::move(conn));
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    }
+
+    run_loop(epoll_fd, conns, creds, opts, stats, 0, 0, rng);
+    setup_done.arrive_and_wait();
+    load_start.arrive_and_wait();
+
+    uint64_t load_end = now_ns() + static_cast<uint64_t>(opts.duration * 1e9);
+    run_loop(epoll_fd, conns, creds, opts, stats, load_end, opts.rate / opts.threads, rng);
+    run_loop(epoll_fd, conns, creds, opts, stats, load_end + static_cast<uint64_t>(opts.grace * 1e9), 0, rng);
+
+    for (BenchConn &conn : conns) close(conn.fd);
+    close(epoll_fd);
+}
+
+bool parse_args(int argc, char *argv[], Options &opts, int &gen_users) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) return false;
+        std::string key = arg.substr(0, eq), value = arg.substr(eq + 1);
+        if (key == "--host") opts.host = value;
+        else if (key == "--port") opts.port = std::stoi(value);
+        else if (key == "--users") opts.users_file = value;
+        else if (key == "--clients") opts.clients = std::stoi(value);
+        else if (key == "--threads") opts.threads = std::max(1, std::stoi(value));
+        else if (key == "--groups") opts.groups = std::max(1, std::stoi(value));
+        else if (key == "--rate") opts.rate = std::stod(value);
+        else if (key == "--duration") opts.duration = std::stod(value);
+        else if (key == "--grace") opts.grace = std::stod(value);
+        else if (key == "--mix") {
+            if (std::sscanf(value.c_str(), "%d:%d:%d", &opts.mix[0], &opts.mix[1], &opts.mix[2]) != 3) return false;
+        } else if (key == "--protocol") {
+            if (value != "binary" && value != "text") return false;
+            opts.mode = value == "binary" ? FrameMode::Binary : FrameMode::Length;
+        } else if (key == "--compress") {
+            if (value != "on" && value != "off") return false;
+            opts.compress = value == "on";
+        } else if (key == "--payload") {
+            opts.payload = std::stoul(value);
+        } else if (key == "--gen-users") gen_users = std::stoi(value);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options opts;
+    int gen_users = 0;
+    if (!parse_args(argc, argv, opts, gen_users)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--host=ADDR] [--port=N] [--users=FILE] [--clients=N] [--threads=N] [--groups=N]\n"
+                     "       [--rate=CMDS_PER_SEC] [--duration=SEC] [--grace=SEC] [--mix=B:P:G]\n"
+                     "       [--protocol=text|binary] [--compress=on|off] [--payload=BYTES]\n"
+                     "       " << argv[0] << " --gen-users=N   (print N benchmark users for users.txt)\n";
+        return 1;
+    }
+    if (gen_users > 0) {
+        for (int i = 0; i < gen_users; ++i) std::cout << "bench" << i << ":pw" << i << "\n";
+        return 0;
+    }
+
+    std::vector<Account> creds = load_accounts(opts.users_file);
+    if (creds.empty()) {
+        std::cerr << "Error: no credentials in " << opts.users_file << std::endl;
+        return 1;
+    }
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::vector<Stats> stats(opts.threads);
+    std::barrier<> setup_done(opts.threads + 1), load_start(opts.threads + 1);
+    uint64_t start = now_ns();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < opts.threads; ++t) {
+        threads.emplace_back(bench_thread, t, std::cref(opts), std::cref(creds),
+                             std::ref(setup_done), std::ref(load_start), std::ref(stats[t]));
+    }
+    setup_done.arrive_and_wait();
+    double connect_secs = (now_ns() - start) / 1e9;
+    load_start.arrive_and_wait();
+    for (auto &thread : threads) thread.join();
+
+    Stats total;
+    for (const Stats &s : stats) {
+        for (int k = 0; k < 3; ++k) {
+            total.sent[k] += s.sent[k];
+            total.delivered[k] += s.delivered[k];
+        }
+        total.errors += s.errors;
+        total.connect_failures += s.connect_failures;
+        total.bytes_received += s.bytes_received;
+        total.latency_ns.merge(s.latency_ns);
+    }
+    uint64_t sent = total.sent[0] + total.sent[1] + total.sent[2];
+    uint64_t delivered = total.delivered[0] + total.delivered[1] + total.delivered[2];
+    int connected = opts.clients - static_cast<int>(total.connect_failures);
+
+    // One "key value" pair per line so runs are easy to diff and to parse.
+    std::printf("clients %d\n", opts.clients);
+    std::printf("connected %d\n", connected);
+    std::printf("connect_seconds %.3f\n", connect_secs);
+    std::printf("connect_rate_per_sec %.1f\n", connected / connect_secs);
+    std::printf("duration_seconds %.3f\n", opts.duration);
+    std::printf("sent %llu\n", (unsigned long long)sent);
+    std::printf("sent_per_sec %.1f\n", sent / opts.duration);
+    for (int k = 0; k < 3; ++k) {
+        std::printf("sent_%s %llu\n", KIND_NAMES[k], (unsigned long long)total.sent[k]);
+        std::printf("delivered_%s %llu\n", KIND_NAMES[k], (unsigned long long)total.delivered[k]);
+    }
+    std::printf("delivered %llu\n", (unsigned long long)delivered);
+    std::printf("delivered_per_sec %.1f\n", delivered / opts.duration);
+    std::printf("errors %llu\n", (unsigned long long)total.errors);
+    std::printf("bytes_received %llu\n", (unsigned long long)total.bytes_received);
+    std::printf("latency_p50_us %.1f\n", total.latency_ns.quantile(0.50) / 1e3);
+    std::printf("latency_p99_us %.1f\n", total.latency_ns.quantile(0.99) / 1e3);
+    std::printf("latency_p999_us %.1f\n", total.latency_ns.quantile(0.999) / 1e3);
+    std::printf("latency_max_us %.1f\n", total.latency_ns.max() / 1e3);
+    return 0;
+}
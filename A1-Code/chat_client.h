@@ -0,0 +1,563 @@
+// Asynchronous client library for the chat server.
+//
+// A ClientLoop runs any number of ChatClients on one thread with epoll, so a
+// single process can hold thousands of sessions. Nothing blocks: connect()
+// returns at once and output is appended to a per-client buffer that is
+// written whenever the socket takes it.
+//
+// Commands are pipelined. When a client is given credentials, the preamble,
+// username and password go out in its first write, and commands sent before
+// the login completes queue behind them; the server handles frames in order,
+// so nothing waits for a round trip. Without credentials the client reports
+// the server's prompts through on_prompt and the caller answers them with
+// send_command().
+//
+// Received frames are decoded as they arrive and reported through callbacks.
+// In binary mode, name frames are recorded and messages reported by name, and
+// send_command() sends /msg, /broadcast and /group_msg as ID frames once the
+// names involved are known. A client that asked for binary mode reconnects in
+// length mode if the server hangs up or answers with something that is not a
+// binary frame before the first one, which is how servers that predate the
+// binary protocol react to its preamble. Binary clients also ask for
+// compression unless told not to, and then deflate large commands.
+//
+// ChatClient callbacks run on the loop thread. Other threads hand work to the
+// loop with post().
+
+#ifndef CHAT_CLIENT_H
+#define CHAT_CLIENT_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "compress.h"
+#include "framing.h"
+
+#define CLIENT_READ_CHUNK 65536
+#define CLIENT_MAX_EVENTS 256
+
+// A username and password, as read from a users file.
+struct Account {
+    std::string username;
+    std::string password;
+};
+
+// Reads "username:password" lines.
+inline std::vector<Account> load_accounts(const std::string &path) {
+    std::vector<Account> accounts;
+    std::ifstream file(path);
+    std::string line, username, password;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        if (std::getline(iss, username, ':') && std::getline(iss, password)) {
+            accounts.push_back({username, password});
+        }
+    }
+    return accounts;
+}
+
+inline uint64_t client_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ClientOptions {
+    std::string host = "127.0.0.1";
+    int port = 12345;
+    FrameMode mode = FrameMode::Binary;  // Binary or Length
+    bool text_fallback = true;           // retry in length mode, see above
+    bool compress = true;                // binary mode: negotiate compression
+    // Logs in without prompting when username is set.
+    std::string username;
+    std::string password;
+};
+
+// One message from the server. Replies, notices and everything received in
+// length mode are Text; the views are valid during the callback only.
+struct ChatMessage {
+    Opcode kind = Opcode::Text;  // Text, Private, Broadcast or Group
+    std::string_view sender = {};
+    std::string_view group = {};
+    std::string_view text = {};
+
+    // The message as the server formats it for text clients.
+    std::string render() const {
+        switch (kind) {
+        case Opcode::Private:
+        case Opcode::Broadcast:
+            return "[" + std::string(sender) + "]: " + std::string(text);
+        case Opcode::Group:
+            return "[Group " + std::string(group) + "][" + std::string(sender) + "]: " + std::string(text);
+        default:
+            return std::string(text);
+        }
+    }
+};
+
+class ChatClient;
+
+// Any callback may be left empty.
+struct ClientEvents {
+    std::function<void(ChatClient &)> on_connected;
+    // The server asked for the username (index 0) or password (index 1).
+    std::function<void(ChatClient &, int index, std::string_view prompt)> on_prompt;
+    // The login was accepted; messages before it are prompts and the reply.
+    std::function<void(ChatClient &)> on_ready;
+    std::function<void(ChatClient &, const ChatMessage &)> on_message;
+    std::function<void(ChatClient &)> on_close;
+};
+
+enum class ClientState { Connecting, Greeting, Login, Ready, Closed };
+
+class ClientLoop;
+
+class ChatClient {
+public:
+    ChatClient(ClientLoop &loop, size_t index, ClientOptions options, ClientEvents events)
+        : loop(loop), client_index(index), options(std::move(options)), events(std::move(events)) {}
+    ChatClient(const ChatClient &) = delete;
+    ChatClient &operator=(const ChatClient &) = delete;
+    ~ChatClient() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    ClientState state() const { return current; }
+    size_t index() const { return client_index; }
+    const ClientOptions &config() const { return options; }
+    FrameMode mode() const { return options.mode; }
+    bool was_ready() const { return logged_in; }
+    // Why the client closed, if it was not the server hanging up.
+    const std::string &error() const { return last_error; }
+
+    uint64_t bytes_received = 0;
+    uint64_t messages_received = 0;
+    uint64_t commands_sent = 0;
+
+    // Sends one typed line: a command once logged in, or an answer to a
+    // prompt. Queued if the client is still connecting.
+    void send_command(std::string_view command) {
+        if (current == ClientState::Closed) return;
+        ++commands_sent;
+        if (!first_frame_seen) replay.emplace_back(command);
+        if (current != ClientState::Ready || !send_by_id(command)) queue_frame(encode_frame(options.mode, command));
+        flush();
+    }
+
+    // Closes the connection and reports on_close.
+    void close() { finish(""); }
+
+private:
+    friend class ClientLoop;
+
+    // Opens the socket and starts a non-blocking connect.
+    bool start();
+    void handle_event(uint32_t events);
+    bool read_input();
+    void flush();
+    void handle_frame(std::string_view frame);
+    // Reconnects in length mode if the server never spoke binary.
+    bool fall_back();
+    void deliver(const ChatMessage &message);
+    void finish(std::string error);
+    // Appends a complete frame, deflated when compression is on and pays off.
+    void queue_frame(std::string frame) {
+        if (options.mode == FrameMode::Binary && options.compress) {
+            std::string packed = deflate_payload(std::string_view(frame).substr(FRAME_HEADER_SIZE));
+            if (!packed.empty()) frame = std::move(packed);
+        }
+        out += frame;
+    }
+    // Sends a command as an ID frame if its target is named; false otherwise.
+    bool send_by_id(std::string_view command);
+    void prompt(int index, std::string_view text) {
+        if (!options.username.empty() || index < prompts_shown) return;
+        prompts_shown = index + 1;
+        if (events.on_prompt) events.on_prompt(*this, index, text);
+    }
+
+    ClientLoop &loop;
+    size_t client_index;
+    ClientOptions options;
+    ClientEvents events;
+    int fd = -1;
+    ClientState current = ClientState::Connecting;
+    bool connected = false;
+    bool logged_in = false;
+    bool first_frame_seen = false;
+    int prompts_shown = 0;
+    std::string last_error;
+    InputBuffer in;
+    FrameParser parser;
+    size_t greeting_left = GREETING.size();
+    std::string out;
+    // Lines sent before the first frame arrived, resent after a fallback.
+    std::vector<std::string> replay;
+    // The payload of the last Deflated frame received.
+    std::string inflated;
+
+    // Binary-mode names, both ways round.
+    std::unordered_map<uint32_t, std::string> users, groups;
+    std::unordered_map<std::string, uint32_t> user_ids, group_ids;
+};
+
+class ClientLoop {
+public:
+    ClientLoop() {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    }
+    ClientLoop(const ClientLoop &) = delete;
+    ClientLoop &operator=(const ClientLoop &) = delete;
+    ~ClientLoop() {
+        clients.clear();
+        ::close(wake_fd);
+        ::close(epoll_fd);
+    }
+
+    // Starts a client. The reference stays valid for the loop's lifetime; a
+    // connect that fails at once is reported through on_close.
+    ChatClient &connect(ClientOptions options, ClientEvents events) {
+        clients.push_back(std::make_unique<ChatClient>(*this, clients.size(), std::move(options), std::move(events)));
+        ChatClient &client = *clients.back();
+        ++open;
+        if (!client.start()) client.finish(client.last_error);
+        return client;
+    }
+
+    ChatClient &client(size_t index) { return *clients[index]; }
+    size_t size() const { return clients.size(); }
+    size_t open_clients() const { return open; }
+
+    // Runs fn on the loop thread. Safe to call from any thread.
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            posted.push_back(std::move(fn));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Handles one batch of events, waiting at most timeout_ms for it.
+    void poll(int timeout_ms) {
+        epoll_event ready[CLIENT_MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, ready, CLIENT_MAX_EVENTS, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            auto *client = static_cast<ChatClient *>(ready[i].data.ptr);
+            if (client) {
+                client->handle_event(ready[i].events);
+            } else {
+                run_posted();
+            }
+        }
+        // Reconnect after the batch, so no stale event reaches the new socket.
+        std::vector<ChatClient *> restarts;
+        restarts.swap(pending_restarts);
+        for (ChatClient *client : restarts) {
+            if (!client->start()) client->finish(client->last_error);
+        }
+    }
+
+    // Runs until stop() or until every client has closed.
+    void run() {
+        stopped = false;
+        while (!stopped && open > 0) poll(-1);
+    }
+    void stop() { stopped = true; }
+
+private:
+    friend class ChatClient;
+
+    void run_posted() {
+        uint64_t count;
+        ssize_t ignored = read(wake_fd, &count, sizeof(count));
+        (void)ignored;
+        std::vector<std::function<void()>> batch;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            batch.swap(posted);
+        }
+        for (auto &fn : batch) fn();
+    }
+
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    bool stopped = false;
+    size_t open = 0;
+    std::vector<std::unique_ptr<ChatClient>> clients;
+    std::vector<ChatClient *> pending_restarts;
+    std::mutex posted_mutex;
+    std::vector<std::function<void()>> posted;
+};
+
+inline bool ChatClient::start() {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        last_error = "Error creating socket.";
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1 ||
+        (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS)) {
+        last_error = "Error connecting to server.";
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = this;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+    current = ClientState::Connecting;
+    in = InputBuffer();
+    parser = FrameParser();
+    parser.mode = options.mode;
+    parser.max_frame = MAX_FRAME_LIMIT;
+    greeting_left = GREETING.size();
+    // Everything known so far goes out in the first write: the preamble, the
+    // login, and any lines sent before a fallback.
+    std::string queued = std::move(out);
+    out.assign(options.mode == FrameMode::Binary ? BINARY_PREAMBLE : PREAMBLE, FRAME_HEADER_SIZE);
+    if (options.mode == FrameMode::Binary && options.compress) out[3] |= PREAMBLE_DEFLATE;
+    if (!options.username.empty()) {
+        queue_frame(encode_frame(options.mode, options.username));
+        queue_frame(encode_frame(options.mode, options.password));
+    }
+    if (replay.empty()) {
+        out += queued;
+    } else {
+        for (const std::string &line : replay) queue_frame(encode_frame(options.mode, line));
+    }
+    return true;
+}
+
+inline void ChatClient::handle_event(uint32_t ready) {
+    if (current == ClientState::Closed) return;
+    if (current == ClientState::Connecting) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+            finish("Error connecting to server.");
+            return;
+        }
+        if (!(ready & (EPOLLOUT | EPOLLIN))) return;
+        current = ClientState::Greeting;
+        // Once per client, not again after a fallback.
+        if (!connected && events.on_connected) {
+            connected = true;
+            events.on_connected(*this);
+        }
+        if (current == ClientState::Closed) return;
+    }
+    if ((ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !read_input()) return;
+    flush();
+}
+
+// Reads until EAGAIN, handling frames as they complete. Returns false once
+// the client has closed or restarted.
+inline bool ChatClient::read_input() {
+    while (current != ClientState::Closed) {
+        char *space = in.write_space(CLIENT_READ_CHUNK);
+        ssize_t n = recv(fd, space, in.writable(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n <= 0) {
+            if (!fall_back()) finish("");
+            return false;
+        }
+        in.commit(n);
+        bytes_received += n;
+
+        if (greeting_left > 0) {
+            size_t skip = std::min(greeting_left, in.readable().size());
+            in.consume(skip);
+            greeting_left -= skip;
+            if (greeting_left > 0) continue;
+            current = ClientState::Login;
+            prompt(0, GREETING);
+        }
+        std::string_view frame;
+        while (current != ClientState::Closed) {
+            ParseResult result = parser.next(in, frame);
+            if (result == ParseResult::NeedMore) break;
+            if (result == ParseResult::Error) {
+                if (!fall_back()) finish("Malformed frame from server.");
+                return false;
+            }
+            handle_frame(frame);
+            if (fd < 0) return false;
+        }
+    }
+    return false;
+}
+
+inline bool ChatClient::fall_back() {
+    if (options.mode != FrameMode::Binary || !options.text_fallback || first_frame_seen) return false;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    fd = -1;
+    options.mode = FrameMode::Length;
+    out.clear();
+    loop.pending_restarts.push_back(this);
+    return true;
+}
+
+inline void ChatClient::flush() {
+    if (current == ClientState::Connecting || current == ClientState::Closed || fd < 0) return;
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            // Reading reports the disconnect; keep any pending frames for it.
+            break;
+        }
+    }
+    out.erase(0, sent);
+}
+
+inline void ChatClient::handle_frame(std::string_view frame) {
+    ChatMessage message;
+    message.text = frame;
+    BinaryFrame binary;
+    if (options.mode == FrameMode::Binary) {
+        bool ok = decode_binary(frame, binary);
+        if (ok && binary.op == Opcode::Deflated) {
+            ok = options.compress && inflate_payload(binary.ids[0], binary.text, parser.max_frame, inflated) &&
+                 decode_binary(inflated, binary) && binary.op != Opcode::Deflated;
+        }
+        if (!ok) {
+            if (!fall_back()) finish("Malformed frame from server.");
+            return;
+        }
+    }
+    if (!first_frame_seen) {
+        first_frame_seen = true;
+        replay.clear();
+        replay.shrink_to_fit();
+    }
+    if (options.mode == FrameMode::Binary) {
+        message.kind = binary.op;
+        message.text = binary.text;
+        switch (binary.op) {
+        case Opcode::UserName:
+            users[binary.ids[0]] = binary.text;
+            user_ids[std::string(binary.text)] = binary.ids[0];
+            return;
+        case Opcode::GroupName:
+            groups[binary.ids[0]] = binary.text;
+            group_ids[std::string(binary.text)] = binary.ids[0];
+            return;
+        case Opcode::Private:
+        case Opcode::Broadcast:
+            message.sender = users[binary.ids[0]];
+            break;
+        case Opcode::Group:
+            message.group = groups[binary.ids[0]];
+            message.sender = users[binary.ids[1]];
+            break;
+        case Opcode::Text:
+            break;
+        default:
+            return;
+        }
+    }
+
+    if (current == ClientState::Login && message.kind == Opcode::Text) {
+        if (message.text == "Enter password: ") {
+            prompt(1, message.text);
+            return;
+        }
+        if (message.text.starts_with("Welcome")) {
+            deliver(message);
+            if (current == ClientState::Closed) return;
+            current = ClientState::Ready;
+            logged_in = true;
+            if (events.on_ready) events.on_ready(*this);
+            return;
+        }
+    }
+    deliver(message);
+}
+
+inline void ChatClient::deliver(const ChatMessage &message) {
+    ++messages_received;
+    if (events.on_message) events.on_message(*this, message);
+}
+
+inline void ChatClient::finish(std::string error) {
+    if (current == ClientState::Closed) return;
+    current = ClientState::Closed;
+    if (!error.empty()) last_error = std::move(error);
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    out.clear();
+    --loop.open;
+    if (events.on_close) events.on_close(*this);
+}
+
+inline bool ChatClient::send_by_id(std::string_view command) {
+    if (options.mode != FrameMode::Binary) return false;
+    if (command.starts_with("/broadcast ")) {
+        queue_frame(encode_binary(Opcode::SendBroadcast, {}, command.substr(11)));
+        return true;
+    }
+    if (command.starts_with("/msg ")) {
+        std::string_view rest = command.substr(5);
+        size_t space = rest.find(' ');
+        if (space == std::string_view::npos) return false;
+        auto it = user_ids.find(std::string(rest.substr(0, space)));
+        if (it == user_ids.end()) return false;
+        queue_frame(encode_binary(Opcode::SendPrivate, {it->second}, rest.substr(space + 1)));
+        return true;
+    }
+    if (command.starts_with("/group_msg ")) {
+        // Group names may contain spaces: use the longest known one.
+        std::string_view rest = command.substr(11);
+        const std::pair<const std::string, uint32_t> *best = nullptr;
+        for (const auto &group : group_ids) {
+            if (rest.size() > group.first.size() && rest.starts_with(group.first) &&
+                rest[group.first.size()] == ' ' && (!best || group.first.size() > best->first.size())) {
+                best = &group;
+            }
+        }
+        if (!best) return false;
+        queue_frame(encode_binary(Opcode::SendGroup, {best->second}, rest.substr(best->first.size() + 1)));
+        return true;
+    }
+    return false;
+}
+
+#endif // CHAT_CLIENT_H
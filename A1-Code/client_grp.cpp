@@ -1,107 +1,272 @@
 // Client-side implementation in C++ for a chat server with private messages and group messaging
+//
+// Interactive mode reads commands from stdin for one session. Batch mode
+// (--script) logs in --clients sessions from one process and has each of them
+// replay a command script at --rate commands per second:
+//
+//   ./client_grp --script=bot.txt --clients=1000 --rate=2 --users=users.txt
+//
+// Script lines are sent as typed. "{user}" is replaced by the session's own
+// username, "{next}" by the next session's and "{index}" by its number; blank
+// lines and lines starting with '#' are skipped.
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <mutex>
-#include <unordered_map>
-#include <unordered_set>
+#include <queue>
 #include <vector>
-#include <sstream>
-#include <cstring>
+#include <cstdio>
 #include <cstdlib>
-#include <unistd.h>
-#include <arpa/inet.h>
-
-#define BUFFER_SIZE 1024
+#include <sys/resource.h>
+#include "chat_client.h"
 
 std::mutex cout_mutex;
 
-void handle_server_messages(int server_socket) {
-    char buffer[BUFFER_SIZE];
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(server_socket, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
+struct Args {
+    ClientOptions client;
+    std::string script;
+    std::string users_file = "users.txt";
+    int clients = 1;
+    double rate = 1;      // commands per second per session; 0 sends the script at once
+    int repeat = 1;       // times each session runs the script
+    double linger = 1;    // seconds to keep receiving after the last command
+    bool quiet = false;   // batch mode: do not print received messages
+};
+
+// Interactive session: prompts and messages go to stdout, lines from stdin
+// become commands. Exits the process when the session ends.
+[[noreturn]] void run_interactive(const Args &args) {
+    ClientLoop loop;
+    bool leaving = false;  // the user typed /exit or closed stdin
+    ClientEvents events;
+    events.on_connected = [](ChatClient &) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << "Connected to the server." << std::endl;
+    };
+    events.on_prompt = [](ChatClient &, int, std::string_view prompt) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << prompt << std::flush;
+    };
+    events.on_message = [](ChatClient &, const ChatMessage &message) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << message.render() << std::endl;
+    };
+    events.on_close = [&leaving](ChatClient &client) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        if (!client.error().empty()) {
+            std::cerr << client.error() << std::endl;
+        } else if (client.was_ready() && !leaving) {
             std::cout << "Disconnected from server." << std::endl;
-            close(server_socket);
-            exit(0);
         }
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        std::cout << buffer << std::endl;
-    }
-}
+    };
+    ChatClient &client = loop.connect(args.client, events);
 
-int main() {
-    int client_socket;
-    sockaddr_in server_address{};
+    // std::getline blocks, so stdin is read on its own thread and each line is
+    // handed to the loop. We use detach because the loop may finish first.
+    std::thread input_thread([&loop, &client, &leaving] {
+        std::string message;
+        while (std::getline(std::cin, message)) {
+            if (message.empty()) continue;
+            if (message == "/exit") break;
+            loop.post([&client, message] { client.send_command(message); });
+        }
+        loop.post([&loop, &client, &leaving] {
+            leaving = true;
+            if (client.state() == ClientState::Ready) client.send_command("/exit");
+            client.close();
+            loop.stop();
+        });
+    });
+    input_thread.detach();
 
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_socket < 0) {
-        std::cerr << "Error creating socket." << std::endl;
-        return 1;
-    }
+    loop.run();
+    // The input thread may still be blocked in getline, holding references to
+    // loop and client, so leave without running their destructors.
+    std::cout.flush();
+    std::quick_exit(client.was_ready() ? 0 : 1);
+}
 
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(12345);
-    server_address.sin_addr.s_addr = inet_addr("127.0.0.1");
+// Replaces the script placeholders for one session.
+std::string expand(std::string_view line, const std::vector<Account> &accounts, size_t index) {
+    std::string out;
+    while (!line.empty()) {
+        size_t open = line.find('{');
+        size_t close = open == std::string_view::npos ? open : line.find('}', open);
+        if (close == std::string_view::npos) break;
+        out.append(line.substr(0, open));
+        std::string_view name = line.substr(open + 1, close - open - 1);
+        if (name == "user") {
+            out += accounts[index % accounts.size()].username;
+        } else if (name == "next") {
+            out += accounts[(index + 1) % accounts.size()].username;
+        } else if (name == "index") {
+            out += std::to_string(index);
+        } else {
+            out.append(line.substr(open, close - open + 1));
+        }
+        line.remove_prefix(close + 1);
+    }
+    out.append(line);
+    return out;
+}
 
-    if (connect(client_socket, (sockaddr*)&server_address, sizeof(server_address)) < 0) {
-        std::cerr << "Error connecting to server." << std::endl;
+// Batch mode: every session runs the script, paced on one event loop.
+int run_script(const Args &args) {
+    std::vector<std::string> script;
+    {
+        std::ifstream file(args.script);
+        if (!file) {
+            std::cerr << "Error: cannot read " << args.script << std::endl;
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty() && line[0] != '#') script.push_back(line);
+        }
+    }
+    std::vector<Account> accounts = load_accounts(args.users_file);
+    if (accounts.empty()) {
+        std::cerr << "Error: no credentials in " << args.users_file << std::endl;
         return 1;
     }
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 
-    std::cout << "Connected to the server." << std::endl;
-
-    // Authentication
-    std::string username, password;
-    char buffer[BUFFER_SIZE];
-
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0); // Receive the message "Enter the user name" for the server
-    // You should have a line like this in the server.cpp code: send_message(client_socket, "Enter username: ");
- 
-    std::cout << buffer;
-    std::getline(std::cin, username);
-    send(client_socket, username.c_str(), username.size(), 0);
-
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0); // Receive the message "Enter the password" for the server
-    std::cout << buffer;
-    std::getline(std::cin, password);
-    send(client_socket, password.c_str(), password.size(), 0);
-
-    memset(buffer, 0, BUFFER_SIZE);
-    // Depending on whether the authentication passes or not, receive the message "Authentication Failed" or "Welcome to the server"
-    recv(client_socket, buffer, BUFFER_SIZE, 0); 
-    std::cout << buffer << std::endl;
+    // Sessions due to send, earliest first: (due time in ns, session index).
+    using Due = std::pair<uint64_t, size_t>;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+    std::vector<size_t> progress(args.clients, 0);  // script lines sent per session
+    size_t total_lines = script.size() * std::max(args.repeat, 0);
+    uint64_t interval = args.rate > 0 ? static_cast<uint64_t>(1e9 / args.rate) : 0;
+    size_t ready = 0, errors = 0;
+    // Sessions that have sent their whole script or closed.
+    std::vector<bool> done(args.clients, false);
+    size_t done_count = 0;
+    auto settle = [&](size_t index) {
+        if (!done[index]) {
+            done[index] = true;
+            ++done_count;
+        }
+    };
 
-    if (std::string(buffer).find("Authentication failed") != std::string::npos) {
-        close(client_socket);
-        return 1;
+    ClientLoop loop;
+    ClientEvents events;
+    events.on_ready = [&](ChatClient &client) {
+        ++ready;
+        if (total_lines == 0) {
+            settle(client.index());
+        } else {
+            due.push({client_now_ns(), client.index()});
+        }
+    };
+    events.on_message = [&](ChatClient &client, const ChatMessage &message) {
+        if (message.kind == Opcode::Text && message.text.starts_with("ERROR")) ++errors;
+        if (args.quiet) return;
+        if (args.clients > 1) std::cout << '[' << client.config().username << "] ";
+        std::cout << message.render() << '\n';
+    };
+    events.on_close = [&](ChatClient &client) {
+        if (!client.error().empty()) std::cerr << client.config().username << ": " << client.error() << std::endl;
+        settle(client.index());
+    };
+    for (int i = 0; i < args.clients; ++i) {
+        ClientOptions options = args.client;
+        options.username = accounts[i % accounts.size()].username;
+        options.password = accounts[i % accounts.size()].password;
+        loop.connect(options, events);
     }
 
-    // Start thread for receiving messages from server
-    std::thread receive_thread(handle_server_messages, client_socket);
-    // We use detach because we want this thread to run in the background while the main thread continues running
-    receive_thread.detach();
-
-    // Send messages to the server
-    while (true) {
-        std::string message;
-        std::getline(std::cin, message);
+    uint64_t linger_until = 0;
+    while (loop.open_clients() > 0) {
+        uint64_t now = client_now_ns();
+        while (!due.empty() && due.top().first <= now) {
+            auto [when, index] = due.top();
+            due.pop();
+            ChatClient &client = loop.client(index);
+            if (client.state() != ClientState::Ready) continue;
+            // With no rate limit the whole script goes out in one write.
+            do {
+                size_t line = progress[index]++;
+                client.send_command(expand(script[line % script.size()], accounts, index));
+            } while (interval == 0 && progress[index] < total_lines);
+            if (progress[index] < total_lines) {
+                due.push({when + interval, index});
+            } else {
+                settle(index);
+            }
+        }
+        // Keep receiving for a while once every session is done.
+        if (!linger_until && done_count == done.size()) {
+            linger_until = now + static_cast<uint64_t>(args.linger * 1e9);
+        }
+        if (linger_until && now >= linger_until) break;
 
-        if (message.empty()) continue;
+        int timeout_ms = 100;
+        uint64_t next = linger_until;
+        if (!due.empty() && (!next || due.top().first < next)) next = due.top().first;
+        if (next) timeout_ms = static_cast<int>(std::min<uint64_t>(next > now ? (next - now) / 1000000 : 0, 100));
+        loop.poll(timeout_ms);
+    }
+    std::cout << std::flush;
 
-        send(client_socket, message.c_str(), message.size(), 0);
+    uint64_t sent = 0, received = 0, bytes = 0;
+    for (size_t i = 0; i < loop.size(); ++i) {
+        sent += loop.client(i).commands_sent;
+        received += loop.client(i).messages_received;
+        bytes += loop.client(i).bytes_received;
+    }
+    // One "key value" pair per line, as chat_bench prints.
+    std::fprintf(stderr, "clients %d\nlogged_in %zu\ncommands_sent %llu\nmessages_received %llu\n"
+                         "bytes_received %llu\nerrors %zu\n",
+                 args.clients, ready, (unsigned long long)sent, (unsigned long long)received,
+                 (unsigned long long)bytes, errors);
+    return ready == size_t(args.clients) ? 0 : 1;
+}
 
-        if (message == "/exit") {
-            close(client_socket);
-            break;
+int main(int argc, char *argv[]) {
+    Args args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--port") {
+            args.client.port = std::stoi(value);
+        } else if (key == "--host") {
+            args.client.host = value;
+        } else if (arg == "--protocol=binary") {
+            args.client.mode = FrameMode::Binary;
+        } else if (arg == "--protocol=text") {
+            args.client.mode = FrameMode::Length;
+        } else if (arg == "--no-compress") {
+            args.client.compress = false;
+        } else if (key == "--script") {
+            args.script = value;
+        } else if (key == "--users") {
+            args.users_file = value;
+        } else if (key == "--clients") {
+            args.clients = std::max(1, std::stoi(value));
+        } else if (key == "--rate") {
+            args.rate = std::stod(value);
+        } else if (key == "--repeat") {
+            args.repeat = std::stoi(value);
+        } else if (key == "--linger") {
+            args.linger = std::stod(value);
+        } else if (arg == "--quiet") {
+            args.quiet = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--host=ADDR] [--port=N] [--protocol=binary|text] [--no-compress]\n"
+                      << "       " << argv[0] << " --script=FILE [--clients=N] [--users=FILE] [--rate=CMDS_PER_SEC]\n"
+                      << "         [--repeat=N] [--linger=SEC] [--quiet]   (batch mode)\n";
+            return 1;
         }
     }
-
-    return 0;
+    if (args.script.empty()) run_interactive(args);
+    return run_script(args);
 }
-
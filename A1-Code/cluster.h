@@ -0,0 +1,583 @@
+// Clustering for the chat server: several server_grp processes share users
+// and groups.
+//
+// Every node keeps one outbound TCP link to every other node it knows about
+// and sends everything for that node over it; a link's receiving end only
+// reads. Nodes are named by the host:port they accept cluster links on.
+//  - Membership is gossiped: each node periodically sends the set of nodes it
+//    knows to all of its peers, and dials any node it has not seen before, so
+//    starting a node with a single seed is enough to join the full mesh.
+//  - Presence and group membership are owned by the node the user is logged
+//    in to. A new link starts with a snapshot of the sender's local state;
+//    after that every change is pushed as a delta. A link delivers in order,
+//    so the receiver's view of that node is always a prefix of its history,
+//    and a lost link simply clears the view until the next snapshot.
+//  - A private message is routed to the node that owns the recipient. A group
+//    message goes once to each node that has members of the group; that node
+//    fans it out to its own members. Broadcasts go once to every node.
+//
+// Each peer has a writer thread that sends whatever accumulated in the peer's
+// buffer since its last write, so a burst of forwards becomes one send().
+//
+// Wire format on a link: u32 big-endian length | u8 type | fields, where a
+// string field is a u32 big-endian length followed by its bytes.
+
+#ifndef CHAT_CLUSTER_H
+#define CHAT_CLUSTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "framing.h"
+
+#define GOSSIP_INTERVAL_MS 500
+#define CLUSTER_MAX_MESSAGE (64u * 1024 * 1024)
+#define MAX_PEER_BUFFER (64u * 1024 * 1024)
+#define CLUSTER_READ_CHUNK (64 * 1024)
+
+enum class ClusterMsg : uint8_t {
+    Hello = 1,       // node id of the sender; first message on every link
+    Nodes = 2,       // count, node ids
+    Snapshot = 3,    // count, users; count, groups; count, (group, user) members
+    UserOnline = 4,  // user
+    UserOffline = 5, // user
+    MemberJoin = 6,  // group, user
+    MemberLeave = 7, // group, user
+    GroupCreate = 8, // group
+    Private = 9,     // recipient, sender, payload
+    GroupText = 10,  // group, formatted text
+    Broadcast = 11,  // formatted text
+};
+
+class Cluster {
+public:
+    // Called on link reader threads for messages routed to this node.
+    struct Handlers {
+        std::function<void(std::string_view recipient, std::string_view sender, std::string_view payload)> on_private;
+        std::function<void(std::string_view group, std::string_view text)> on_group_text;
+        std::function<void(std::string_view text)> on_broadcast;
+        std::function<void(std::string_view group)> on_group_created;
+    };
+
+    // Starts accepting links on self ("host:port") and dialing the seeds.
+    // Returns false if the cluster port cannot be bound.
+    bool start(const std::string &self_id, const std::vector<std::string> &seeds, Handlers handlers_) {
+        self = self_id;
+        handlers = std::move(handlers_);
+        sockaddr_in addr{};
+        if (!parse_address(self, addr)) return false;
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+            close(listen_fd);
+            return false;
+        }
+        {
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            for (const std::string &seed : seeds) {
+                if (seed != self) known_nodes.insert(seed);
+            }
+        }
+        std::thread([this] { accept_loop(); }).detach();
+        std::thread([this] { gossip_loop(); }).detach();
+        return true;
+    }
+
+    // Local state changes, pushed to every peer in the order they happen.
+    void user_online(std::string_view user) {
+        std::unique_lock<std::shared_mutex> lock(local_mutex);
+        local_users.emplace(user);
+        publish_locked(encode(ClusterMsg::UserOnline, {user}));
+    }
+    void user_offline(std::string_view user) {
+        std::unique_lock<std::shared_mutex> lock(local_mutex);
+        local_users.erase(std::string(user));
+        publish_locked(encode(ClusterMsg::UserOffline, {user}));
+    }
+    void member_joined(std::string_view group, std::string_view user) {
+        std::unique_lock<std::shared_mutex> lock(local_mutex);
+        local_members[std::string(group)].emplace(user);
+        publish_locked(encode(ClusterMsg::MemberJoin, {group, user}));
+    }
+    void member_left(std::string_view group, std::string_view user) {
+        std::unique_lock<std::shared_mutex> lock(local_mutex);
+        auto it = local_members.find(std::string(group));
+        if (it != local_members.end()) {
+            it->second.erase(std::string(user));
+            if (it->second.empty()) local_members.erase(it);
+        }
+        publish_locked(encode(ClusterMsg::MemberLeave, {group, user}));
+    }
+    void group_created(std::string_view group) {
+        std::unique_lock<std::shared_mutex> lock(local_mutex);
+        if (!known_groups.emplace(group).second) return;
+        publish_locked(encode(ClusterMsg::GroupCreate, {group}));
+    }
+
+    // Sends a private message to the node the recipient is logged in to, the
+    // latest one if there are several. Returns false if no other node has the
+    // recipient online.
+    bool forward_private(std::string_view recipient, std::string_view sender, std::string_view payload) {
+        std::string owner;
+        {
+            std::shared_lock<std::shared_mutex> lock(remote_mutex);
+            auto it = owners.find(std::string(recipient));
+            if (it == owners.end()) return false;
+            owner = it->second.back();
+        }
+        std::shared_lock<std::shared_mutex> lock(local_mutex);
+        auto peer = peers.find(owner);
+        if (peer == peers.end()) return false;
+        peer->second->send(encode(ClusterMsg::Private, {recipient, sender, payload}));
+        return true;
+    }
+
+    // Sends a formatted group message once to every node with members in group.
+    void forward_group(std::string_view group, std::string_view text) {
+        std::vector<std::string> targets;
+        {
+            std::shared_lock<std::shared_mutex> lock(remote_mutex);
+            for (const auto &[node, view] : views) {
+                auto it = view.members.find(std::string(group));
+                if (it != view.members.end() && !it->second.empty()) targets.push_back(node);
+            }
+        }
+        if (targets.empty()) return;
+        std::string message = encode(ClusterMsg::GroupText, {group, text});
+        std::shared_lock<std::shared_mutex> lock(local_mutex);
+        for (const std::string &node : targets) {
+            auto peer = peers.find(node);
+            if (peer != peers.end()) peer->second->send(message);
+        }
+    }
+
+    void forward_broadcast(std::string_view text) {
+        std::string message = encode(ClusterMsg::Broadcast, {text});
+        std::shared_lock<std::shared_mutex> lock(local_mutex);
+        for (const auto &[node, peer] : peers) peer->send(message);
+    }
+
+private:
+    // Outbound link to one node, drained by its own writer thread.
+    struct Peer {
+        std::string id;
+        int fd = -1;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::string out;
+        bool closed = false;
+
+        void send(std::string_view message) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (closed) return;
+                if (out.size() + message.size() > MAX_PEER_BUFFER) {
+                    // Too far behind to catch up; the link is redialed and
+                    // starts again from a snapshot.
+                    closed = true;
+                    shutdown(fd, SHUT_RDWR);
+                } else {
+                    out.append(message);
+                }
+            }
+            cv.notify_one();
+        }
+    };
+
+    // What this node knows about another node's local state.
+    struct NodeView {
+        uint64_t link = 0;  // which inbound link the view came from
+        std::unordered_set<std::string> users;
+        std::unordered_map<std::string, std::unordered_set<std::string>> members;
+    };
+
+    static void put_u32(std::string &out, uint32_t value) {
+        out.push_back(char(value >> 24));
+        out.push_back(char(value >> 16));
+        out.push_back(char(value >> 8));
+        out.push_back(char(value));
+    }
+    static void put_str(std::string &out, std::string_view s) {
+        put_u32(out, s.size());
+        out.append(s);
+    }
+
+    static std::string encode(ClusterMsg type, std::initializer_list<std::string_view> fields) {
+        std::string body(1, static_cast<char>(type));
+        for (std::string_view field : fields) put_str(body, field);
+        std::string out;
+        put_u32(out, body.size());
+        return out + body;
+    }
+
+    // Reads the fields of one message body in order.
+    struct Reader {
+        std::string_view data;
+        bool ok = true;
+
+        uint32_t u32() {
+            if (data.size() < 4) {
+                ok = false;
+                return 0;
+            }
+            auto b = reinterpret_cast<const unsigned char *>(data.data());
+            uint32_t value = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+            data.remove_prefix(4);
+            return value;
+        }
+        std::string_view str() {
+            uint32_t len = u32();
+            if (!ok || data.size() < len) {
+                ok = false;
+                return {};
+            }
+            std::string_view s = data.substr(0, len);
+            data.remove_prefix(len);
+            return s;
+        }
+    };
+
+    static bool parse_address(const std::string &id, sockaddr_in &addr) {
+        size_t colon = id.rfind(':');
+        if (colon == std::string::npos) return false;
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(std::stoi(id.substr(colon + 1))));
+        return inet_pton(AF_INET, id.substr(0, colon).c_str(), &addr.sin_addr) == 1;
+    }
+
+    // Caller holds local_mutex exclusively, which orders deltas with snapshots.
+    void publish_locked(const std::string &message) {
+        for (const auto &[node, peer] : peers) peer->send(message);
+    }
+
+    std::string nodes_message_locked() const {
+        std::string body(1, static_cast<char>(ClusterMsg::Nodes));
+        put_u32(body, known_nodes.size() + 1);
+        put_str(body, self);
+        for (const std::string &node : known_nodes) put_str(body, node);
+        std::string out;
+        put_u32(out, body.size());
+        return out + body;
+    }
+
+    std::string snapshot_message_locked() const {
+        std::string body(1, static_cast<char>(ClusterMsg::Snapshot));
+        put_u32(body, local_users.size());
+        for (const std::string &user : local_users) put_str(body, user);
+        put_u32(body, known_groups.size());
+        for (const std::string &group : known_groups) put_str(body, group);
+        size_t count = 0;
+        for (const auto &[group, users] : local_members) count += users.size();
+        put_u32(body, count);
+        for (const auto &[group, users] : local_members) {
+            for (const std::string &user : users) {
+                put_str(body, group);
+                put_str(body, user);
+            }
+        }
+        std::string out;
+        put_u32(out, body.size());
+        return out + body;
+    }
+
+    // Dials every known node without a live link and gossips the node list.
+    void gossip_loop() {
+        while (true) {
+            std::vector<std::string> to_dial;
+            {
+                std::shared_lock<std::shared_mutex> lock(local_mutex);
+                for (const std::string &node : known_nodes) {
+                    if (!peers.count(node)) to_dial.push_back(node);
+                }
+            }
+            for (const std::string &node : to_dial) dial(node);
+            {
+                std::unique_lock<std::shared_mutex> lock(local_mutex);
+                publish_locked(nodes_message_locked());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(GOSSIP_INTERVAL_MS));
+        }
+    }
+
+    void dial(const std::string &node) {
+        sockaddr_in addr{};
+        if (!parse_address(node, addr)) return;
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return;
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto peer = std::make_shared<Peer>();
+        peer->id = node;
+        peer->fd = fd;
+        {
+            // The snapshot and the link's registration happen atomically with
+            // respect to deltas, so the peer sees every change exactly once.
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            peer->out = encode(ClusterMsg::Hello, {self}) + snapshot_message_locked() + nodes_message_locked();
+            peers[node] = peer;
+        }
+        std::thread([this, peer] { write_loop(peer); }).detach();
+    }
+
+    void write_loop(std::shared_ptr<Peer> peer) {
+        std::string batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(peer->mutex);
+                peer->cv.wait(lock, [&] { return !peer->out.empty() || peer->closed; });
+                if (peer->closed) break;
+                batch.swap(peer->out);
+            }
+            std::string_view data = batch;
+            while (!data.empty()) {
+                ssize_t n = ::send(peer->fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                data.remove_prefix(n);
+            }
+            if (!data.empty()) break;
+            batch.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(peer->mutex);
+            peer->closed = true;
+        }
+        {
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            auto it = peers.find(peer->id);
+            if (it != peers.end() && it->second == peer) peers.erase(it);
+        }
+        close(peer->fd);
+    }
+
+    void accept_loop() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+            std::thread([this, fd] { read_loop(fd); }).detach();
+        }
+    }
+
+    void read_loop(int fd) {
+        InputBuffer in;
+        std::string origin;
+        uint64_t link = next_link++;
+        bool ok = true;
+        while (ok) {
+            char *space = in.write_space(CLUSTER_READ_CHUNK);
+            ssize_t n = recv(fd, space, in.writable(), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            in.commit(n);
+            while (true) {
+                std::string_view avail = in.readable();
+                if (avail.size() < 4) break;
+                Reader header{avail.substr(0, 4)};
+                uint32_t len = header.u32();
+                if (len == 0 || len > CLUSTER_MAX_MESSAGE) {
+                    ok = false;
+                    break;
+                }
+                if (avail.size() < 4 + len) break;
+                ok = handle(avail.substr(4, len), origin, link);
+                in.consume(4 + len);
+                if (!ok) break;
+            }
+        }
+        close(fd);
+        if (!origin.empty()) drop_view(origin, link);
+    }
+
+    // Applies one message from the node at the other end of an inbound link.
+    bool handle(std::string_view body, std::string &origin, uint64_t link) {
+        ClusterMsg type = static_cast<ClusterMsg>(body[0]);
+        Reader r{body.substr(1)};
+        if (type != ClusterMsg::Hello && origin.empty()) return false;
+
+        switch (type) {
+        case ClusterMsg::Hello: {
+            origin = r.str();
+            {
+                std::unique_lock<std::shared_mutex> lock(remote_mutex);
+                clear_view_locked(origin);
+                views[origin].link = link;
+            }
+            // Make sure the link back exists too.
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            if (origin != self) known_nodes.insert(origin);
+            break;
+        }
+        case ClusterMsg::Nodes: {
+            uint32_t count = r.u32();
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            for (uint32_t i = 0; i < count && r.ok; ++i) {
+                std::string_view node = r.str();
+                if (r.ok && node != self) known_nodes.emplace(node);
+            }
+            break;
+        }
+        case ClusterMsg::Snapshot: {
+            std::vector<std::string> new_groups;
+            {
+                std::unique_lock<std::shared_mutex> lock(remote_mutex);
+                clear_view_locked(origin);
+                NodeView &view = views[origin];
+                view.link = link;
+                for (uint32_t i = 0, n = r.u32(); i < n && r.ok; ++i) {
+                    std::string user(r.str());
+                    add_owner_locked(user, origin);
+                    view.users.insert(std::move(user));
+                }
+                for (uint32_t i = 0, n = r.u32(); i < n && r.ok; ++i) new_groups.emplace_back(r.str());
+                for (uint32_t i = 0, n = r.u32(); i < n && r.ok; ++i) {
+                    std::string group(r.str());
+                    view.members[group].emplace(r.str());
+                }
+            }
+            for (const std::string &group : new_groups) learn_group(group);
+            break;
+        }
+        case ClusterMsg::UserOnline: {
+            std::string user(r.str());
+            std::unique_lock<std::shared_mutex> lock(remote_mutex);
+            views[origin].users.insert(user);
+            add_owner_locked(user, origin);
+            break;
+        }
+        case ClusterMsg::UserOffline: {
+            std::string user(r.str());
+            std::unique_lock<std::shared_mutex> lock(remote_mutex);
+            views[origin].users.erase(user);
+            remove_owner_locked(user, origin);
+            break;
+        }
+        case ClusterMsg::MemberJoin: {
+            std::string group(r.str());
+            std::string user(r.str());
+            std::unique_lock<std::shared_mutex> lock(remote_mutex);
+            views[origin].members[group].insert(user);
+            break;
+        }
+        case ClusterMsg::MemberLeave: {
+            std::string group(r.str());
+            std::string user(r.str());
+            std::unique_lock<std::shared_mutex> lock(remote_mutex);
+            auto &members = views[origin].members;
+            auto it = members.find(group);
+            if (it != members.end()) {
+                it->second.erase(user);
+                if (it->second.empty()) members.erase(it);
+            }
+            break;
+        }
+        case ClusterMsg::GroupCreate:
+            learn_group(r.str());
+            break;
+        case ClusterMsg::Private: {
+            std::string_view recipient = r.str();
+            std::string_view sender = r.str();
+            std::string_view payload = r.str();
+            if (r.ok) handlers.on_private(recipient, sender, payload);
+            break;
+        }
+        case ClusterMsg::GroupText: {
+            std::string_view group = r.str();
+            std::string_view text = r.str();
+            if (r.ok) handlers.on_group_text(group, text);
+            break;
+        }
+        case ClusterMsg::Broadcast: {
+            std::string_view text = r.str();
+            if (r.ok) handlers.on_broadcast(text);
+            break;
+        }
+        default:
+            return false;
+        }
+        return r.ok;
+    }
+
+    // A group created elsewhere. It is recorded as known before the local
+    // registry learns it so this node does not announce it back.
+    void learn_group(std::string_view group) {
+        {
+            std::unique_lock<std::shared_mutex> lock(local_mutex);
+            if (!known_groups.emplace(group).second) return;
+        }
+        handlers.on_group_created(group);
+    }
+
+    void clear_view_locked(const std::string &origin) {
+        auto it = views.find(origin);
+        if (it == views.end()) return;
+        for (const std::string &user : it->second.users) remove_owner_locked(user, origin);
+        views.erase(it);
+    }
+
+    // A user can be logged in to several nodes at once; owners lists them
+    // oldest first, so one logging out leaves the others reachable.
+    void add_owner_locked(const std::string &user, const std::string &node) {
+        std::vector<std::string> &nodes = owners[user];
+        if (std::find(nodes.begin(), nodes.end(), node) == nodes.end()) nodes.push_back(node);
+    }
+    void remove_owner_locked(const std::string &user, const std::string &node) {
+        auto it = owners.find(user);
+        if (it == owners.end()) return;
+        std::erase(it->second, node);
+        if (it->second.empty()) owners.erase(it);
+    }
+
+    // Forgets a node's state when its link closes, unless a newer link from
+    // the same node has already replaced it.
+    void drop_view(const std::string &origin, uint64_t link) {
+        std::unique_lock<std::shared_mutex> lock(remote_mutex);
+        auto it = views.find(origin);
+        if (it != views.end() && it->second.link == link) clear_view_locked(origin);
+    }
+
+    std::string self;
+    Handlers handlers;
+    int listen_fd = -1;
+    std::atomic<uint64_t> next_link{1};
+
+    // This node's own state and its outbound links.
+    mutable std::shared_mutex local_mutex;
+    std::unordered_set<std::string> known_nodes;
+    std::unordered_map<std::string, std::shared_ptr<Peer>> peers;
+    std::unordered_set<std::string> local_users;
+    std::unordered_map<std::string, std::unordered_set<std::string>> local_members;
+    std::unordered_set<std::string> known_groups;
+
+    // Everything learned from other nodes.
+    mutable std::shared_mutex remote_mutex;
+    std::unordered_map<std::string, NodeView> views;
+    std::unordered_map<std::string, std::vector<std::string>> owners;  // user -> nodes
+};
+
+#endif // CHAT_CLUSTER_H
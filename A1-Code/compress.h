@@ -0,0 +1,95 @@
+// Per-frame compression for the binary protocol, using zlib's raw deflate.
+//
+// A client asks for compression by setting PREAMBLE_DEFLATE in the version
+// byte of its binary preamble. Either side may then replace any binary frame
+// with a Deflated frame whose id field is the size of the original payload
+// (opcode, ids and text) and whose text is that payload deflated on its own.
+// Only payloads of at least COMPRESS_MIN_BYTES are tried, and a frame is sent
+// as-is when deflating does not shrink it.
+//
+// Every frame is compressed independently, so the server deflates a fan-out
+// message once and shares the result with every recipient that negotiated
+// compression. Each thread keeps one deflate and one inflate stream and resets
+// them between frames, so a frame costs no allocation inside zlib.
+
+#ifndef CHAT_COMPRESS_H
+#define CHAT_COMPRESS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+#include "framing.h"
+
+#define COMPRESS_MIN_BYTES 256
+
+namespace compress_detail {
+
+struct Deflater {
+    z_stream stream{};
+    bool ok;
+    Deflater() { ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK; }
+    ~Deflater() {
+        if (ok) deflateEnd(&stream);
+    }
+};
+
+struct Inflater {
+    z_stream stream{};
+    bool ok;
+    Inflater() { ok = inflateInit2(&stream, -15) == Z_OK; }
+    ~Inflater() {
+        if (ok) inflateEnd(&stream);
+    }
+};
+
+} // namespace compress_detail
+
+// Returns a complete Deflated frame for a binary frame payload, or an empty
+// string if the payload is small or does not compress.
+inline std::string deflate_payload(std::string_view payload) {
+    if (payload.size() < COMPRESS_MIN_BYTES) return {};
+    thread_local compress_detail::Deflater deflater;
+    if (!deflater.ok) return {};
+    z_stream &z = deflater.stream;
+    deflateReset(&z);
+
+    // Header, then the deflated bytes straight into the same buffer.
+    constexpr size_t header = FRAME_HEADER_SIZE + 1 + 4;
+    std::string out(header + deflateBound(&z, payload.size()), '\0');
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(payload.data()));
+    z.avail_in = payload.size();
+    z.next_out = reinterpret_cast<Bytef *>(out.data() + header);
+    z.avail_out = out.size() - header;
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) return {};
+    size_t frame_size = header + z.total_out;
+    if (frame_size >= FRAME_HEADER_SIZE + payload.size()) return {};
+    out.resize(frame_size);
+
+    std::string prefix;
+    append_u32(prefix, frame_size - FRAME_HEADER_SIZE);
+    prefix.push_back(static_cast<char>(Opcode::Deflated));
+    append_u32(prefix, payload.size());
+    out.replace(0, header, prefix);
+    return out;
+}
+
+// Inflates the text of a Deflated frame into out. Fails if the data is
+// corrupt or does not inflate to exactly `size` bytes, or if size exceeds
+// max_size, so a small frame cannot expand without bound.
+inline bool inflate_payload(uint32_t size, std::string_view data, size_t max_size, std::string &out) {
+    if (size == 0 || size > max_size) return false;
+    thread_local compress_detail::Inflater inflater;
+    if (!inflater.ok) return false;
+    z_stream &z = inflater.stream;
+    inflateReset(&z);
+
+    out.resize(size);
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    z.avail_in = data.size();
+    z.next_out = reinterpret_cast<Bytef *>(out.data());
+    z.avail_out = size;
+    return inflate(&z, Z_FINISH) == Z_STREAM_END && z.avail_out == 0 && z.avail_in == 0;
+}
+
+#endif // CHAT_COMPRESS_H
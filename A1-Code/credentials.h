@@ -0,0 +1,289 @@
+// Credential store for the chat server.
+//
+// Users come from one of two files, told apart by their first bytes:
+//  - the plain text file, one "username:password" per line (the original
+//    users.txt format, still accepted so accounts can be edited by hand)
+//  - a compact hashed file written by `server_grp --hash-users=OUT`
+//
+// The hashed file stores PBKDF2-HMAC-SHA256 with a random 16-byte salt per
+// user. It is memory-mapped and used in place: a fixed-size entry per user,
+// sorted by a hash of the name and searched with a binary search, followed by
+// a pool of names. Loading it is a stat and an mmap, however many users it
+// holds. Layout (host byte order):
+//   header: char magic[8] | u32 iterations | u32 count | u64 names_offset
+//   entry:  u64 name_hash | u32 name_offset | u16 name_len | u16 reserved |
+//           u8 salt[16] | u8 hash[32]
+//
+// The loaded table is an immutable snapshot published through an atomic
+// shared_ptr; reload_if_changed() swaps in a new one when the file changes, so
+// logins in progress keep using the table they started with.
+
+#ifndef CHAT_CREDENTIALS_H
+#define CHAT_CREDENTIALS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#define CREDENTIAL_MAGIC "CHUSERS1"
+#define CREDENTIAL_HEADER_SIZE 24
+#define CREDENTIAL_ENTRY_SIZE 64
+#define SALT_SIZE 16
+#define HASH_SIZE 32
+#define DEFAULT_HASH_ITERATIONS 100000
+
+class CredentialTable {
+public:
+    CredentialTable() = default;
+    CredentialTable(const CredentialTable &) = delete;
+    CredentialTable &operator=(const CredentialTable &) = delete;
+    ~CredentialTable() {
+        if (map) munmap(map, map_size);
+    }
+
+    // Loads path in whichever format it is in. Returns nullptr if the file
+    // cannot be read or a hashed file is malformed.
+    static std::shared_ptr<const CredentialTable> load(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        struct stat st{};
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        auto table = std::make_shared<CredentialTable>();
+        size_t size = st.st_size;
+        char magic[8] = {};
+        if (size >= CREDENTIAL_HEADER_SIZE && pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+            std::memcmp(magic, CREDENTIAL_MAGIC, sizeof(magic)) == 0) {
+            bool ok = table->map_hashed(fd, size);
+            ::close(fd);
+            return ok ? table : nullptr;
+        }
+        ::close(fd);
+        table->parse_text(path);
+        return table;
+    }
+
+    // Checks a password. Deliberately slow for hashed entries, so call it
+    // off the I/O threads. Unknown users cost the same as a wrong password.
+    bool verify(std::string_view username, std::string_view password) const {
+        if (!map) {
+            auto it = plain.find(std::string(username));
+            if (it == plain.end()) return false;
+            return it->second.size() == password.size() &&
+                   CRYPTO_memcmp(it->second.data(), password.data(), password.size()) == 0;
+        }
+        const char *entry = find_entry(username);
+        static const unsigned char dummy_salt[SALT_SIZE] = {};
+        const unsigned char *salt = entry ? reinterpret_cast<const unsigned char *>(entry + 16) : dummy_salt;
+        unsigned char computed[HASH_SIZE];
+        derive(password, salt, iterations, computed);
+        return entry && CRYPTO_memcmp(computed, entry + 32, HASH_SIZE) == 0;
+    }
+
+    bool contains(std::string_view username) const {
+        return map ? find_entry(username) != nullptr : plain.count(std::string(username)) != 0;
+    }
+
+    size_t size() const { return map ? count : plain.size(); }
+    bool hashed() const { return map != nullptr; }
+
+    // Plain-text entries only, in file order; used to build a hashed file.
+    const std::vector<std::pair<std::string, std::string>> &text_entries() const { return text_order; }
+
+    static void derive(std::string_view password, const unsigned char *salt, uint32_t iterations,
+                       unsigned char *out) {
+        PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()), salt, SALT_SIZE,
+                          static_cast<int>(iterations), EVP_sha256(), HASH_SIZE, out);
+    }
+
+    // FNV-1a; stable across runs, unlike std::hash, because it is stored on disk.
+    static uint64_t name_hash(std::string_view name) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : name) hash = (hash ^ c) * 1099511628211ull;
+        return hash;
+    }
+
+private:
+    template <typename T>
+    static T get(const char *p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    bool map_hashed(int fd, size_t size) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) return false;
+        map = static_cast<char *>(mapped);
+        map_size = size;
+        iterations = get<uint32_t>(map + 8);
+        count = get<uint32_t>(map + 12);
+        names_offset = get<uint64_t>(map + 16);
+        return iterations > 0 && names_offset == CREDENTIAL_HEADER_SIZE + uint64_t(count) * CREDENTIAL_ENTRY_SIZE &&
+               names_offset <= size;
+    }
+
+    void parse_text(const std::string &path) {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string username = line.substr(0, colon);
+            std::string password = line.substr(colon + 1);
+            // A repeated username replaces the earlier line, as before.
+            if (plain.insert_or_assign(username, password).second) {
+                text_order.emplace_back(std::move(username), std::move(password));
+            } else {
+                for (auto &entry : text_order) {
+                    if (entry.first == username) entry.second = std::move(password);
+                }
+            }
+        }
+    }
+
+    const char *find_entry(std::string_view username) const {
+        uint64_t hash = name_hash(username);
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (get<uint64_t>(entry_at(mid)) < hash) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < count && get<uint64_t>(entry_at(lo)) == hash; ++lo) {
+            const char *entry = entry_at(lo);
+            uint64_t offset = names_offset + get<uint32_t>(entry + 8);
+            uint16_t len = get<uint16_t>(entry + 12);
+            if (offset + len <= map_size && std::string_view(map + offset, len) == username) return entry;
+        }
+        return nullptr;
+    }
+
+    const char *entry_at(size_t i) const { return map + CREDENTIAL_HEADER_SIZE + i * CREDENTIAL_ENTRY_SIZE; }
+
+    // Hashed file
+    char *map = nullptr;
+    size_t map_size = 0;
+    uint32_t iterations = 0;
+    uint32_t count = 0;
+    uint64_t names_offset = 0;
+
+    // Plain text file
+    std::unordered_map<std::string, std::string> plain;
+    std::vector<std::pair<std::string, std::string>> text_order;
+};
+
+// The current credential table plus the file it came from.
+class CredentialStore {
+public:
+    bool load(const std::string &file) {
+        path = file;
+        struct stat st{};
+        if (stat(path.c_str(), &st) < 0) return false;
+        auto next = CredentialTable::load(path);
+        if (!next) return false;
+        loaded_mtime = st.st_mtim;
+        loaded_size = st.st_size;
+        table.store(std::move(next), std::memory_order_release);
+        return true;
+    }
+
+    // Reloads the file if its size or modification time changed. A file that
+    // fails to load, say one caught mid-rewrite, leaves the current table in
+    // place and is tried again on the next call. Returns true on reload.
+    bool reload_if_changed() {
+        struct stat st{};
+        if (stat(path.c_str(), &st) < 0) return false;
+        if (st.st_mtim.tv_sec == loaded_mtime.tv_sec && st.st_mtim.tv_nsec == loaded_mtime.tv_nsec &&
+            st.st_size == loaded_size) {
+            return false;
+        }
+        auto next = CredentialTable::load(path);
+        if (!next) return false;
+        loaded_mtime = st.st_mtim;
+        loaded_size = st.st_size;
+        table.store(std::move(next), std::memory_order_release);
+        return true;
+    }
+
+    std::shared_ptr<const CredentialTable> snapshot() const { return table.load(std::memory_order_acquire); }
+
+private:
+    std::string path;
+    timespec loaded_mtime{};
+    off_t loaded_size = 0;
+    std::atomic<std::shared_ptr<const CredentialTable>> table{std::make_shared<const CredentialTable>()};
+};
+
+// Hashes every entry of a plain-text users file on `threads` threads and
+// writes the compact format to out (via a temporary file and rename, so a
+// running server never maps a half-written file). Returns false on I/O error.
+inline bool write_hashed_credentials(const CredentialTable &source, const std::string &out, uint32_t iterations,
+                                     unsigned threads) {
+    const auto &entries = source.text_entries();
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::vector<uint64_t> hashes(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) hashes[i] = CredentialTable::name_hash(entries[i].first);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return hashes[a] < hashes[b]; });
+
+    uint64_t names_offset = CREDENTIAL_HEADER_SIZE + uint64_t(entries.size()) * CREDENTIAL_ENTRY_SIZE;
+    std::string bytes(names_offset, '\0');
+    std::memcpy(bytes.data(), CREDENTIAL_MAGIC, 8);
+    uint32_t count = entries.size();
+    std::memcpy(bytes.data() + 8, &iterations, 4);
+    std::memcpy(bytes.data() + 12, &count, 4);
+    std::memcpy(bytes.data() + 16, &names_offset, 8);
+
+    for (size_t slot = 0; slot < order.size(); ++slot) {
+        const std::string &name = entries[order[slot]].first;
+        char *entry = bytes.data() + CREDENTIAL_HEADER_SIZE + slot * CREDENTIAL_ENTRY_SIZE;
+        uint32_t name_offset = bytes.size() - names_offset;
+        uint16_t name_len = std::min<size_t>(name.size(), UINT16_MAX);
+        std::memcpy(entry, &hashes[order[slot]], 8);
+        std::memcpy(entry + 8, &name_offset, 4);
+        std::memcpy(entry + 12, &name_len, 2);
+        if (RAND_bytes(reinterpret_cast<unsigned char *>(entry + 16), SALT_SIZE) != 1) return false;
+        bytes.append(name, 0, name_len);
+    }
+
+    // The slow part: one PBKDF2 per user, spread over the threads.
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::max(1u, threads); ++t) {
+        workers.emplace_back([&] {
+            for (size_t slot = next++; slot < order.size(); slot = next++) {
+                char *entry = bytes.data() + CREDENTIAL_HEADER_SIZE + slot * CREDENTIAL_ENTRY_SIZE;
+                CredentialTable::derive(entries[order[slot]].second, reinterpret_cast<unsigned char *>(entry + 16),
+                                        iterations, reinterpret_cast<unsigned char *>(entry + 32));
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    std::string tmp = out + ".tmp";
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.write(bytes.data(), bytes.size()) || !file.flush()) return false;
+    file.close();
+    return std::rename(tmp.c_str(), out.c_str()) == 0;
+}
+
+#endif // CHAT_CREDENTIALS_H
@@ -0,0 +1,267 @@
+// Wire framing shared by the chat server and client.
+//
+// A connection starts in one of three modes, picked from its first bytes:
+//  - Length mode: the client opens with the 4-byte preamble below, after which
+//    every message in both directions is a 4-byte big-endian length followed
+//    by that many payload bytes.
+//  - Binary mode: the same preamble with version 2. Frames are length-prefixed
+//    as in length mode and start with an opcode byte; see Opcode below.
+//  - Line mode: anything else (telnet, nc). Messages are terminated by '\n'
+//    and a trailing '\r' is dropped.
+// The server sends GREETING as raw bytes before it knows the mode, so a
+// length- or binary-mode client must read and discard exactly
+// GREETING.size() bytes before it starts decoding frames.
+//
+// Binary frames carry user and group IDs as 4-byte big-endian integers instead
+// of names. IDs are assigned by the server the client is connected to; before
+// a frame uses an ID for the first time, the server sends a UserName or
+// GroupName frame binding it to a name. A delivery is therefore encoded once,
+// whoever receives it, and is a few bytes longer than its text. Binary frames
+// may also be compressed; see compress.h.
+//
+// Frames are limited to FrameParser::max_frame bytes, MAX_FRAME_SIZE unless
+// the owner raises it; the server sizes it from --max-message.
+
+#ifndef CHAT_FRAMING_H
+#define CHAT_FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#define FRAME_HEADER_SIZE 4
+#define MAX_FRAME_SIZE (64 * 1024)
+#define MAX_FRAME_LIMIT (16 * 1024 * 1024)  // ceiling for max_frame; clients accept up to this
+
+constexpr std::string_view GREETING = "Enter username: ";
+constexpr unsigned char PROTOCOL_VERSION = 1;
+constexpr unsigned char BINARY_PROTOCOL_VERSION = 2;
+constexpr char PREAMBLE[FRAME_HEADER_SIZE] = {'\0', 'C', 'H', static_cast<char>(PROTOCOL_VERSION)};
+constexpr char BINARY_PREAMBLE[FRAME_HEADER_SIZE] = {'\0', 'C', 'H', static_cast<char>(BINARY_PROTOCOL_VERSION)};
+// Set in the version byte of a binary preamble to ask for compression.
+constexpr unsigned char PREAMBLE_DEFLATE = 0x80;
+
+enum class FrameMode { Unknown, Line, Length, Binary };
+constexpr int FRAME_MODES = 4;
+
+// First byte of a binary frame; `id` fields are 4-byte big-endian.
+enum class Opcode : uint8_t {
+    // Both directions
+    Text = 0x01,          // text: a prompt or reply, or a command in the text syntax
+    // Server to client
+    Private = 0x02,       // sender id | text
+    Broadcast = 0x03,     // sender id | text
+    Group = 0x04,         // group id | sender id | text
+    UserName = 0x05,      // user id | name
+    GroupName = 0x06,     // group id | name
+    // Both directions, once compression is negotiated
+    Deflated = 0x07,      // inflated size | raw deflate of another frame's payload
+    // Client to server
+    SendPrivate = 0x11,   // recipient id | text
+    SendBroadcast = 0x12, // text
+    SendGroup = 0x13,     // group id | text
+};
+
+// Number of id fields that precede the text for each opcode.
+inline int opcode_ids(Opcode op) {
+    switch (op) {
+    case Opcode::Text:
+    case Opcode::SendBroadcast:
+        return 0;
+    case Opcode::Private:
+    case Opcode::Broadcast:
+    case Opcode::UserName:
+    case Opcode::GroupName:
+    case Opcode::Deflated:
+    case Opcode::SendPrivate:
+    case Opcode::SendGroup:
+        return 1;
+    case Opcode::Group:
+        return 2;
+    }
+    return -1;
+}
+
+// Receive buffer for one connection. Data is appended at the tail and frames
+// are consumed from the head; unread bytes are moved back to the front only
+// when the tail runs out of room, so every complete frame is contiguous and
+// can be handed out as a string_view without copying. Storage is allocated on
+// first use and released once drained, so idle connections hold no buffer.
+class InputBuffer {
+public:
+    // Returns a writable region of at least min_space bytes at the tail.
+    char *write_space(size_t min_space) {
+        if (capacity - tail < min_space) {
+            make_room(min_space);
+        }
+        return data.get() + tail;
+    }
+    size_t writable() const { return capacity - tail; }
+    void commit(size_t n) { tail += n; }
+
+    std::string_view readable() const { return {data.get() + head, tail - head}; }
+    void consume(size_t n) {
+        head += n;
+        if (head == tail) {
+            head = tail = 0;
+        }
+    }
+
+    // Frees the storage if nothing is pending and it grew past the idle size.
+    void shrink_if_idle(size_t idle_capacity) {
+        if (head == tail && capacity > idle_capacity) {
+            data.reset();
+            capacity = head = tail = 0;
+        }
+    }
+
+private:
+    void make_room(size_t min_space) {
+        size_t pending = tail - head;
+        if (head > 0 && capacity - pending >= min_space) {
+            std::memmove(data.get(), data.get() + head, pending);
+        } else {
+            size_t new_capacity = capacity ? capacity : 4096;
+            while (new_capacity - pending < min_space) new_capacity *= 2;
+            std::unique_ptr<char[]> grown(new char[new_capacity]);
+            if (pending) std::memcpy(grown.get(), data.get() + head, pending);
+            data = std::move(grown);
+            capacity = new_capacity;
+        }
+        head = 0;
+        tail = pending;
+    }
+
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+enum class ParseResult { Frame, NeedMore, Error };
+
+// Incremental frame decoder. next() returns views into the InputBuffer that
+// stay valid until the buffer is written to again.
+class FrameParser {
+public:
+    FrameMode mode = FrameMode::Unknown;
+    bool deflate = false;  // the binary preamble asked for compression
+    size_t max_frame = MAX_FRAME_SIZE;
+
+    ParseResult next(InputBuffer &in, std::string_view &frame) {
+        std::string_view avail = in.readable();
+        if (avail.empty()) return ParseResult::NeedMore;
+
+        if (mode == FrameMode::Unknown) {
+            if (avail[0] != PREAMBLE[0]) {
+                mode = FrameMode::Line;
+            } else if (avail.size() < FRAME_HEADER_SIZE) {
+                return ParseResult::NeedMore;
+            } else {
+                unsigned char version = avail[3];
+                if (std::memcmp(avail.data(), PREAMBLE, FRAME_HEADER_SIZE - 1) != 0 ||
+                    (version != PROTOCOL_VERSION && (version & ~PREAMBLE_DEFLATE) != BINARY_PROTOCOL_VERSION)) {
+                    return ParseResult::Error;
+                }
+                mode = version == PROTOCOL_VERSION ? FrameMode::Length : FrameMode::Binary;
+                deflate = version & PREAMBLE_DEFLATE;
+                in.consume(FRAME_HEADER_SIZE);
+                avail = in.readable();
+                if (avail.empty()) return ParseResult::NeedMore;
+            }
+        }
+
+        if (mode == FrameMode::Line) {
+            const void *nl = std::memchr(avail.data(), '\n', avail.size());
+            if (!nl) {
+                return avail.size() > max_frame ? ParseResult::Error : ParseResult::NeedMore;
+            }
+            size_t len = static_cast<const char *>(nl) - avail.data();
+            frame = avail.substr(0, len);
+            if (!frame.empty() && frame.back() == '\r') frame.remove_suffix(1);
+            in.consume(len + 1);
+            return ParseResult::Frame;
+        }
+
+        if (avail.size() < FRAME_HEADER_SIZE) return ParseResult::NeedMore;
+        uint32_t len = decode_length(avail.data());
+        if (len > max_frame || (mode == FrameMode::Binary && len == 0)) return ParseResult::Error;
+        if (avail.size() < FRAME_HEADER_SIZE + len) return ParseResult::NeedMore;
+        frame = avail.substr(FRAME_HEADER_SIZE, len);
+        in.consume(FRAME_HEADER_SIZE + len);
+        return ParseResult::Frame;
+    }
+
+    static uint32_t decode_length(const char *p) {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+        return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+    }
+};
+
+inline void append_u32(std::string &out, uint32_t value) {
+    out.push_back(char(value >> 24));
+    out.push_back(char(value >> 16));
+    out.push_back(char(value >> 8));
+    out.push_back(char(value));
+}
+
+// Encodes one complete binary frame.
+inline std::string encode_binary(Opcode op, std::initializer_list<uint32_t> ids, std::string_view text) {
+    std::string out;
+    uint32_t len = 1 + 4 * ids.size() + text.size();
+    out.reserve(FRAME_HEADER_SIZE + len);
+    append_u32(out, len);
+    out.push_back(static_cast<char>(op));
+    for (uint32_t id : ids) append_u32(out, id);
+    out.append(text);
+    return out;
+}
+
+// A decoded binary frame; text points into the frame.
+struct BinaryFrame {
+    Opcode op;
+    uint32_t ids[2];
+    std::string_view text;
+};
+
+// Splits a binary frame (without its length prefix). Returns false if the
+// opcode is unknown or the frame is too short for its ids.
+inline bool decode_binary(std::string_view frame, BinaryFrame &out) {
+    if (frame.empty()) return false;
+    out.op = static_cast<Opcode>(frame[0]);
+    int ids = opcode_ids(out.op);
+    if (ids < 0 || frame.size() < 1 + 4 * size_t(ids)) return false;
+    for (int i = 0; i < ids; ++i) out.ids[i] = FrameParser::decode_length(frame.data() + 1 + 4 * i);
+    out.text = frame.substr(1 + 4 * ids);
+    return true;
+}
+
+// Encodes one outbound message for the given mode; in binary mode it becomes
+// a Text frame. Before the mode is known the payload is sent as-is.
+inline std::string encode_frame(FrameMode mode, std::string_view payload) {
+    std::string out;
+    if (mode == FrameMode::Binary) {
+        return encode_binary(Opcode::Text, {}, payload);
+    } else if (mode == FrameMode::Length) {
+        uint32_t len = payload.size();
+        out.reserve(FRAME_HEADER_SIZE + len);
+        out.push_back(char(len >> 24));
+        out.push_back(char(len >> 16));
+        out.push_back(char(len >> 8));
+        out.push_back(char(len));
+        out.append(payload);
+    } else if (mode == FrameMode::Line) {
+        out.reserve(payload.size() + 1);
+        out.append(payload);
+        out.push_back('\n');
+    } else {
+        out.assign(payload);
+    }
+    return out;
+}
+
+#endif // CHAT_FRAMING_H
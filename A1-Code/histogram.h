@@ -0,0 +1,76 @@
+// Fixed-size log-linear latency histogram.
+//
+// Values below 2^SUB_BUCKET_BITS are counted exactly; above that each power of
+// two is split into 2^SUB_BUCKET_BITS buckets, so every recorded value is
+// accurate to within 1/128 (under 1%). Recording is a couple of shifts and one
+// increment, and histograms from different threads can simply be merged.
+
+#ifndef CHAT_HISTOGRAM_H
+#define CHAT_HISTOGRAM_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#define SUB_BUCKET_BITS 7
+
+class Histogram {
+public:
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value) {
+        ++counts[index_of(value)];
+        ++total;
+        sum += value;
+        if (value > max_value) max_value = value;
+    }
+
+    void merge(const Histogram &other) {
+        for (int i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+
+    // Returns the smallest bucket value v such that at least q of the
+    // recorded values are <= v (q in [0, 1]).
+    uint64_t quantile(double q) const {
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * total);
+        if (rank >= total) rank = total - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) return value_of(i);
+        }
+        return max_value;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+    double mean() const { return total ? double(sum) / total : 0.0; }
+    const std::array<uint64_t, BUCKETS> &buckets() const { return counts; }
+
+    static int index_of(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<int>(value);
+        int shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+    }
+
+    // Upper bound of the values that land in bucket i.
+    static uint64_t value_of(int index) {
+        if (index < SUB_BUCKETS) return index;
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t base = uint64_t(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return base + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max_value = 0;
+};
+
+#endif // CHAT_HISTOGRAM_H
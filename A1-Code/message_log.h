@@ -0,0 +1,443 @@
+// Append-only, segmented message log for the chat server.
+//
+// Every private, group and broadcast message is appended as one record with a
+// dense, monotonically increasing offset. Records go to in-memory batches; a
+// flusher thread writes each batch with pwrite and makes it durable with one
+// fdatasync every FLUSH_INTERVAL_MS (group commit), so no message waits for
+// its own fsync. A crash can lose at most the last interval of messages.
+//
+// The log is split into SEGMENT_SIZE files named after their first offset.
+// Each segment is preallocated and memory-mapped, so reads are plain memcpys.
+// At startup the segments are scanned, a torn tail is cut off and zeroed from
+// the first record with a bad checksum, and these in-memory indexes are rebuilt:
+//  - by_user: private messages sent or received by each user
+//  - by_group: messages sent to each group
+//  - broadcasts
+//  - pending_offline: private messages not yet delivered, per recipient
+//
+// Record layout (host byte order):
+//   u32 body_len | u32 checksum(body) |
+//   u64 offset | u64 timestamp_ms | u8 kind | u8 flags |
+//   u16 target_len | u16 sender_len | u32 payload_len | target | sender | payload
+
+#ifndef CHAT_MESSAGE_LOG_H
+#define CHAT_MESSAGE_LOG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SEGMENT_SIZE (64u * 1024 * 1024)
+#define FLUSH_INTERVAL_MS 5
+#define RECORD_HEADER_SIZE 8
+#define RECORD_FIXED_SIZE 26
+#define MAX_NAME_SIZE 0xFFFF  // target and sender lengths are stored as u16
+
+enum class RecordKind : uint8_t { Private = 1, Group = 2, Broadcast = 3, Delivered = 4 };
+
+// Set on a private message whose recipient was offline when it was sent.
+#define RECORD_FLAG_OFFLINE 0x1
+
+struct LogRecord {
+    uint64_t offset = 0;
+    uint64_t timestamp_ms = 0;
+    RecordKind kind = RecordKind::Private;
+    uint8_t flags = 0;
+    std::string target;   // recipient username or group name
+    std::string sender;
+    std::string payload;
+};
+
+class MessageLog {
+public:
+    ~MessageLog() { close_log(); }
+
+    // Opens or creates the log in dir and recovers its indexes. Returns false
+    // if the directory or a segment cannot be opened, or another process
+    // already has the log open.
+    bool open(const std::string &dir) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) return false;
+        directory = dir;
+        lock_fd = ::open((dir + "/LOCK").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock_fd < 0 || flock(lock_fd, LOCK_EX | LOCK_NB) < 0) return false;
+
+        std::vector<uint64_t> bases;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() == 24 && name.ends_with(".log")) bases.push_back(std::stoull(name.substr(0, 20)));
+        }
+        std::sort(bases.begin(), bases.end());
+        for (size_t i = 0; i < bases.size(); ++i) {
+            if (!open_segment(bases[i])) return false;
+            if (!recover_segment(segments.size() - 1)) {
+                // Torn tail: appends resume here and later segments are unreachable.
+                if (!zero_tail(segments.back(), write_pos)) return false;
+                for (size_t j = i + 1; j < bases.size(); ++j) std::filesystem::remove(segment_path(bases[j]), ec);
+                break;
+            }
+        }
+        if (segments.empty() && !open_segment(0)) return false;
+
+        flusher = std::thread([this] { flush_loop(); });
+        return true;
+    }
+
+    void close_log() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || !flusher.joinable()) return;
+            stopping = true;
+        }
+        cv.notify_all();
+        flusher.join();
+        for (Segment &seg : segments) {
+            munmap(seg.map, SEGMENT_SIZE);
+            ::close(seg.fd);
+        }
+        segments.clear();
+    }
+
+    // Appends one record and returns its offset, or UINT64_MAX if a new
+    // segment could not be created or target or sender is longer than
+    // MAX_NAME_SIZE. Durable within FLUSH_INTERVAL_MS; visible to readers
+    // immediately.
+    uint64_t append(RecordKind kind, std::string_view target, std::string_view sender,
+                    std::string_view payload, uint8_t flags = 0) {
+        if (target.size() > MAX_NAME_SIZE || sender.size() > MAX_NAME_SIZE) return UINT64_MAX;
+        std::lock_guard<std::mutex> lock(mutex);
+        return append_locked(kind, target, sender, payload, flags);
+    }
+
+    // Returns up to limit of the most recent undelivered private messages for
+    // user, oldest first, and records that the backlog has been delivered.
+    // Older undelivered messages stay reachable through history().
+    std::vector<LogRecord> take_offline(const std::string &user, size_t limit) {
+        std::vector<uint64_t> offsets;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = pending_offline.find(user);
+            if (it == pending_offline.end()) return {};
+            offsets = std::move(it->second);
+            pending_offline.erase(it);
+            append_locked(RecordKind::Delivered, user, "", "", 0);
+        }
+        if (offsets.size() > limit) offsets.erase(offsets.begin(), offsets.end() - limit);
+        return read_records(offsets);
+    }
+
+    // Messages visible to user with offset >= from: private messages to or
+    // from them, messages to the given groups, and broadcasts. At most limit
+    // records, oldest first.
+    std::vector<LogRecord> history(const std::string &user, const std::vector<std::string> &group_names,
+                                   uint64_t from, size_t limit) {
+        std::vector<uint64_t> offsets;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto take = [&](const std::vector<uint64_t> &list) {
+                auto it = std::lower_bound(list.begin(), list.end(), from);
+                for (size_t n = 0; it != list.end() && n < limit; ++it, ++n) offsets.push_back(*it);
+            };
+            if (auto it = by_user.find(user); it != by_user.end()) take(it->second);
+            for (const std::string &group : group_names) {
+                if (auto it = by_group.find(group); it != by_group.end()) take(it->second);
+            }
+            take(broadcasts);
+        }
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+        if (offsets.size() > limit) offsets.resize(limit);
+        return read_records(offsets);
+    }
+
+    uint64_t next_offset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return locations.size();
+    }
+
+private:
+    struct Segment {
+        uint64_t base;
+        int fd;
+        char *map;
+    };
+    struct Location {
+        uint32_t segment;
+        uint32_t pos;
+    };
+    // Bytes appended to one segment starting at pos but not yet written.
+    struct Batch {
+        uint32_t segment;
+        uint32_t pos;
+        std::string bytes;
+    };
+
+    uint64_t append_locked(RecordKind kind, std::string_view target, std::string_view sender,
+                           std::string_view payload, uint8_t flags) {
+        uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t offset = locations.size();
+        size_t size = RECORD_HEADER_SIZE + RECORD_FIXED_SIZE + target.size() + sender.size() + payload.size();
+        if (write_pos + size > SEGMENT_SIZE) {
+            if (!open_segment(offset)) return UINT64_MAX;
+        }
+
+        if (pending.empty() || pending.back().segment != segments.size() - 1) {
+            pending.push_back({static_cast<uint32_t>(segments.size() - 1), write_pos, {}});
+        }
+        std::string &bytes = pending.back().bytes;
+        size_t start = bytes.size();
+        bytes.resize(start + size);
+        char *p = bytes.data() + start;
+        uint32_t body_len = size - RECORD_HEADER_SIZE;
+        char *body = p + RECORD_HEADER_SIZE;
+        put(body, offset);
+        put(body + 8, now_ms);
+        body[16] = static_cast<char>(kind);
+        body[17] = static_cast<char>(flags);
+        put(body + 18, static_cast<uint16_t>(target.size()));
+        put(body + 20, static_cast<uint16_t>(sender.size()));
+        put(body + 22, static_cast<uint32_t>(payload.size()));
+        char *var = body + RECORD_FIXED_SIZE;
+        std::memcpy(var, target.data(), target.size());
+        std::memcpy(var + target.size(), sender.data(), sender.size());
+        std::memcpy(var + target.size() + sender.size(), payload.data(), payload.size());
+        put(p, body_len);
+        put(p + 4, checksum(body, body_len));
+
+        index_record(offset, kind, flags, target, sender, {static_cast<uint32_t>(segments.size() - 1), write_pos});
+        write_pos += size;
+        return offset;
+    }
+
+    template <typename T>
+    static void put(char *p, T value) { std::memcpy(p, &value, sizeof(T)); }
+    template <typename T>
+    static T get(const char *p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    // FNV-1a; only needs to catch torn or partially written records.
+    static uint32_t checksum(const char *data, size_t len) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; ++i) hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        return hash;
+    }
+
+    std::string segment_path(uint64_t base) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu.log", static_cast<unsigned long long>(base));
+        return directory + "/" + name;
+    }
+
+    bool open_segment(uint64_t base) {
+        std::string path = segment_path(base);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, SEGMENT_SIZE) < 0) {
+            ::close(fd);
+            return false;
+        }
+        void *map = mmap(nullptr, SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        segments.push_back({base, fd, static_cast<char *>(map)});
+        write_pos = 0;
+        return true;
+    }
+
+    // Rebuilds the indexes from one segment. Returns false if the segment ends
+    // in a torn or corrupt record, which becomes the new end of the log.
+    bool recover_segment(size_t seg_index) {
+        const char *map = segments[seg_index].map;
+        uint32_t pos = 0;
+        while (pos + RECORD_HEADER_SIZE + RECORD_FIXED_SIZE <= SEGMENT_SIZE) {
+            uint32_t body_len = get<uint32_t>(map + pos);
+            if (body_len == 0) break;  // preallocated, never written
+            if (body_len < RECORD_FIXED_SIZE || pos + RECORD_HEADER_SIZE + body_len > SEGMENT_SIZE) {
+                write_pos = pos;
+                return false;
+            }
+            const char *body = map + pos + RECORD_HEADER_SIZE;
+            uint64_t offset = get<uint64_t>(body);
+            if (get<uint32_t>(map + pos + 4) != checksum(body, body_len) || offset != locations.size()) {
+                write_pos = pos;
+                return false;
+            }
+            uint16_t target_len = get<uint16_t>(body + 18);
+            uint16_t sender_len = get<uint16_t>(body + 20);
+            std::string_view target(body + RECORD_FIXED_SIZE, target_len);
+            std::string_view sender(body + RECORD_FIXED_SIZE + target_len, sender_len);
+            index_record(offset, static_cast<RecordKind>(body[16]), body[17], target, sender,
+                         {static_cast<uint32_t>(seg_index), pos});
+            pos += RECORD_HEADER_SIZE + body_len;
+        }
+        write_pos = pos;
+        return true;
+    }
+
+    // Zeroes [pos, SEGMENT_SIZE) by cutting the file and growing it back, so
+    // new appends cannot leave torn bytes after their last record that a
+    // later recovery would read as a record header.
+    static bool zero_tail(const Segment &segment, uint32_t pos) {
+        return ftruncate(segment.fd, pos) == 0 && ftruncate(segment.fd, SEGMENT_SIZE) == 0 &&
+               fdatasync(segment.fd) == 0;
+    }
+
+    void index_record(uint64_t offset, RecordKind kind, uint8_t flags, std::string_view target,
+                      std::string_view sender, Location location) {
+        locations.push_back(location);
+        switch (kind) {
+        case RecordKind::Private:
+            by_user[std::string(target)].push_back(offset);
+            if (sender != target) by_user[std::string(sender)].push_back(offset);
+            if (flags & RECORD_FLAG_OFFLINE) pending_offline[std::string(target)].push_back(offset);
+            break;
+        case RecordKind::Group:
+            by_group[std::string(target)].push_back(offset);
+            break;
+        case RecordKind::Broadcast:
+            broadcasts.push_back(offset);
+            break;
+        case RecordKind::Delivered:
+            pending_offline.erase(std::string(target));
+            break;
+        }
+    }
+
+    // Copies records out of the mapped segments, or out of a batch that the
+    // flusher has not written yet.
+    std::vector<LogRecord> read_records(const std::vector<uint64_t> &offsets) {
+        std::vector<LogRecord> records;
+        records.reserve(offsets.size());
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint64_t offset : offsets) {
+            Location loc = locations[offset];
+            const char *p = segments[loc.segment].map + loc.pos;
+            for (const auto *batches : {&inflight, &pending}) {
+                for (const Batch &batch : *batches) {
+                    if (batch.segment == loc.segment && loc.pos >= batch.pos && loc.pos < batch.pos + batch.bytes.size()) {
+                        p = batch.bytes.data() + (loc.pos - batch.pos);
+                    }
+                }
+            }
+            const char *body = p + RECORD_HEADER_SIZE;
+            LogRecord record;
+            record.offset = get<uint64_t>(body);
+            record.timestamp_ms = get<uint64_t>(body + 8);
+            record.kind = static_cast<RecordKind>(body[16]);
+            record.flags = body[17];
+            uint16_t target_len = get<uint16_t>(body + 18);
+            uint16_t sender_len = get<uint16_t>(body + 20);
+            uint32_t payload_len = get<uint32_t>(body + 22);
+            const char *var = body + RECORD_FIXED_SIZE;
+            record.target.assign(var, target_len);
+            record.sender.assign(var + target_len, sender_len);
+            record.payload.assign(var + target_len + sender_len, payload_len);
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    // Group commit: every FLUSH_INTERVAL_MS, write all pending batches and
+    // fdatasync each segment they touched once. A batch that cannot be
+    // written (ENOSPC, EIO) is reported and kept, ahead of newer batches, and
+    // retried on the next interval; its records stay readable from memory.
+    void flush_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this] { return stopping; });
+            if (pending.empty()) {
+                if (stopping) return;
+                continue;
+            }
+            inflight.swap(pending);
+            std::vector<int> fds;
+            for (const Batch &batch : inflight) fds.push_back(segments[batch.segment].fd);
+            lock.unlock();
+
+            std::vector<size_t> written(inflight.size(), 0);
+            int error = 0;
+            for (size_t i = 0; i < inflight.size() && !error; ++i) {
+                const Batch &batch = inflight[i];
+                size_t &done = written[i];
+                while (done < batch.bytes.size()) {
+                    ssize_t n = pwrite(fds[i], batch.bytes.data() + done, batch.bytes.size() - done, batch.pos + done);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        error = n < 0 ? errno : ENOSPC;
+                        break;
+                    }
+                    done += n;
+                }
+            }
+            std::sort(fds.begin(), fds.end());
+            fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+            for (int fd : fds) {
+                if (fdatasync(fd) < 0 && !error) error = errno;
+            }
+
+            lock.lock();
+            // Batches not fully written go back, whole, in front of the ones
+            // appended meanwhile; rewriting the same bytes is harmless
+            std::vector<Batch> unwritten;
+            for (size_t i = 0; i < inflight.size(); ++i) {
+                if (written[i] < inflight[i].bytes.size()) unwritten.push_back(std::move(inflight[i]));
+            }
+            inflight.clear();
+            // Reported once per failure, not on every retry
+            if (error && (!write_failing || stopping || unwritten.empty())) {
+                std::cerr << "Error writing message log in " << directory << ": " << std::strerror(error)
+                          << (unwritten.empty() ? "." : stopping ? "; unwritten messages are lost." : "; retrying.")
+                          << std::endl;
+            }
+            if (error && stopping) return;
+            write_failing = error && !unwritten.empty();
+            pending.insert(pending.begin(), std::make_move_iterator(unwritten.begin()),
+                           std::make_move_iterator(unwritten.end()));
+        }
+    }
+
+    std::string directory;
+    int lock_fd = -1;  // held for the life of the process
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread flusher;
+    bool stopping = false;
+
+    std::vector<Segment> segments;
+    uint32_t write_pos = 0;
+    std::vector<Batch> pending;
+    std::vector<Batch> inflight;
+    bool write_failing = false;  // the last flush left batches unwritten
+
+    std::vector<Location> locations;  // indexed by offset
+    std::unordered_map<std::string, std::vector<uint64_t>> by_user;
+    std::unordered_map<std::string, std::vector<uint64_t>> by_group;
+    std::vector<uint64_t> broadcasts;
+    std::unordered_map<std::string, std::vector<uint64_t>> pending_offline;
+};
+
+#endif // CHAT_MESSAGE_LOG_H
@@ -0,0 +1,225 @@
+// Runtime metrics for the chat server.
+//
+// Hot paths record into state owned by the calling thread, so recording never
+// contends with another thread: counters are atomics written only by their
+// owner (a relaxed load and store, no read-modify-write), and histograms sit
+// behind a per-thread mutex that only a scrape ever competes for. Each thread
+// registers its slot on first use; slots live for the rest of the process,
+// which suits the server's long-lived thread pools.
+//
+// render_metrics() merges every thread's slot and prints the Prometheus text format.
+// Histograms are exposed as summaries (quantiles, _sum, _count) because the
+// log-linear buckets are far too many to print as Prometheus buckets.
+//
+// Lock timing reads the clock twice per acquisition, so only one acquisition
+// in LOCK_SAMPLE_RATE per thread is timed.
+
+#ifndef CHAT_METRICS_H
+#define CHAT_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+#define LOCK_SAMPLE_RATE 64
+
+enum class Counter {
+    Accepts,
+    AuthSuccesses,
+    AuthFailures,
+    CommandMsg,
+    CommandBroadcast,
+    CommandGroupMsg,
+    CommandOther,
+    BytesIn,
+    BytesOut,
+    MessagesQueued,
+    MessagesDropped,
+    SlowConsumerDisconnects,
+    RateLimited,
+    RateLimitDisconnects,
+    DeflatedFrames,
+    DeflateSavedBytes,
+    Count
+};
+
+// Locks whose wait and hold times are sampled.
+enum class LockSite { RegistryRead, RegistryWrite, GroupWrite, OutboundQueue, Count };
+
+enum class Metric {
+    FanoutSize,         // recipients of one broadcast or group message on this node
+    QueueDepthBytes,    // a connection's outbound queue after an enqueue
+    CommandLatencyNs,   // time to run one command
+    AuthLatencyUs,      // password submitted to login completed
+    LockWaitNs,
+    LockHoldNs = LockWaitNs + static_cast<int>(LockSite::Count),
+    Count = LockHoldNs + static_cast<int>(LockSite::Count)
+};
+
+constexpr int COUNTER_COUNT = static_cast<int>(Counter::Count);
+constexpr int METRIC_COUNT = static_cast<int>(Metric::Count);
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Metrics {
+public:
+    struct ThreadSlot {
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+        std::mutex histogram_mutex;
+        // Allocated on first use; a Histogram is ~58 KiB.
+        std::array<std::unique_ptr<Histogram>, METRIC_COUNT> histograms;
+        uint32_t lock_sample = 0;
+    };
+
+    static Metrics &instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    static ThreadSlot &local() {
+        thread_local ThreadSlot *slot = instance().register_thread();
+        return *slot;
+    }
+
+    // Merged copy of every thread's counters and histograms.
+    void collect(std::array<uint64_t, COUNTER_COUNT> &counters, std::vector<Histogram> &histograms) {
+        counters.fill(0);
+        histograms.assign(METRIC_COUNT, Histogram());
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        for (const auto &slot : slots) {
+            for (int i = 0; i < COUNTER_COUNT; ++i) counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> hist_lock(slot->histogram_mutex);
+            for (int i = 0; i < METRIC_COUNT; ++i) {
+                if (slot->histograms[i]) histograms[i].merge(*slot->histograms[i]);
+            }
+        }
+    }
+
+private:
+    ThreadSlot *register_thread() {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        slots.push_back(std::make_unique<ThreadSlot>());
+        return slots.back().get();
+    }
+
+    std::mutex slots_mutex;
+    std::vector<std::unique_ptr<ThreadSlot>> slots;
+};
+
+inline void increment(Counter counter, uint64_t n = 1) {
+    auto &value = Metrics::local().counters[static_cast<int>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void observe(Metric metric, uint64_t value) {
+    Metrics::ThreadSlot &slot = Metrics::local();
+    std::lock_guard<std::mutex> lock(slot.histogram_mutex);
+    auto &histogram = slot.histograms[static_cast<int>(metric)];
+    if (!histogram) histogram = std::make_unique<Histogram>();
+    histogram->record(value);
+}
+
+// A lock guard that times the wait for, and the hold of, one acquisition in
+// LOCK_SAMPLE_RATE. Lock is std::unique_lock or std::shared_lock.
+template <typename Lock>
+class TimedLock {
+public:
+    template <typename Mutex>
+    TimedLock(Mutex &mutex, LockSite site) : lock(mutex, std::defer_lock), site(static_cast<int>(site)) {
+        sampled = ++Metrics::local().lock_sample % LOCK_SAMPLE_RATE == 0;
+        if (!sampled) {
+            lock.lock();
+            return;
+        }
+        uint64_t start = now_ns();
+        lock.lock();
+        acquired = now_ns();
+        observe(static_cast<Metric>(static_cast<int>(Metric::LockWaitNs) + this->site), acquired - start);
+    }
+
+    ~TimedLock() {
+        if (!sampled) return;
+        uint64_t held = now_ns() - acquired;
+        lock.unlock();
+        observe(static_cast<Metric>(static_cast<int>(Metric::LockHoldNs) + site), held);
+    }
+
+    TimedLock(const TimedLock &) = delete;
+    TimedLock &operator=(const TimedLock &) = delete;
+
+private:
+    Lock lock;
+    int site;
+    bool sampled = false;
+    uint64_t acquired = 0;
+};
+
+// Prometheus text exposition of everything recorded so far, plus any extra
+// gauges supplied by the caller as ready-made lines.
+inline std::string render_metrics(const std::string &extra_gauges = "") {
+    static const char *counter_names[COUNTER_COUNT] = {
+        "chat_accepts_total", "chat_auth_successes_total", "chat_auth_failures_total",
+        "chat_commands_total{command=\"msg\"}", "chat_commands_total{command=\"broadcast\"}",
+        "chat_commands_total{command=\"group_msg\"}", "chat_commands_total{command=\"other\"}",
+        "chat_bytes_in_total", "chat_bytes_out_total", "chat_messages_queued_total",
+        "chat_messages_dropped_total", "chat_slow_consumer_disconnects_total",
+        "chat_rate_limited_total", "chat_rate_limit_disconnects_total",
+        "chat_deflated_frames_total", "chat_deflate_saved_bytes_total",
+    };
+    static const char *lock_names[static_cast<int>(LockSite::Count)] = {
+        "registry_read", "registry_write", "group_write", "outbound_queue",
+    };
+
+    std::array<uint64_t, COUNTER_COUNT> counters;
+    std::vector<Histogram> histograms;
+    Metrics::instance().collect(counters, histograms);
+
+    std::string out;
+    std::string last_family;
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        std::string name = counter_names[i];
+        std::string family = name.substr(0, name.find('{'));
+        if (family != last_family) {
+            out += "# TYPE " + family + " counter\n";
+            last_family = family;
+        }
+        out += name + " " + std::to_string(counters[i]) + "\n";
+    }
+
+    auto summary = [&](const std::string &family, const std::string &labels, const Histogram &h, bool header) {
+        if (header) out += "# TYPE " + family + " summary\n";
+        std::string sep = labels.empty() ? "" : labels + ",";
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            char quantile[16];
+            std::snprintf(quantile, sizeof(quantile), "%g", q);
+            out += family + "{" + sep + "quantile=\"" + quantile + "\"} " + std::to_string(h.quantile(q)) + "\n";
+        }
+        std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        out += family + "_sum" + braces + " " + std::to_string(static_cast<uint64_t>(h.mean() * h.count())) + "\n";
+        out += family + "_count" + braces + " " + std::to_string(h.count()) + "\n";
+    };
+    summary("chat_fanout_size", "", histograms[static_cast<int>(Metric::FanoutSize)], true);
+    summary("chat_queue_depth_bytes", "", histograms[static_cast<int>(Metric::QueueDepthBytes)], true);
+    summary("chat_command_latency_ns", "", histograms[static_cast<int>(Metric::CommandLatencyNs)], true);
+    summary("chat_auth_latency_us", "", histograms[static_cast<int>(Metric::AuthLatencyUs)], true);
+    for (int kind = 0; kind < 2; ++kind) {
+        std::string family = kind == 0 ? "chat_lock_wait_ns" : "chat_lock_hold_ns";
+        int base = static_cast<int>(kind == 0 ? Metric::LockWaitNs : Metric::LockHoldNs);
+        for (int site = 0; site < static_cast<int>(LockSite::Count); ++site) {
+            summary(family, std::string("lock=\"") + lock_names[site] + "\"", histograms[base + site], site == 0);
+        }
+    }
+    return out + extra_gauges;
+}
+
+#endif // CHAT_METRICS_H
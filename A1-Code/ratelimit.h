@@ -0,0 +1,91 @@
+// Rate limiting for the chat server.
+//
+// Every limit is a token bucket: `rate` tokens per second refill it up to
+// `burst`. A bucket is a single atomic 64-bit word holding how many
+// thousandths of a token it is short of full (high half) and the millisecond
+// clock of its last update (low half), changed with one compare-and-swap.
+// Buckets shared between workers, per user and per group, therefore never
+// take a lock, and a connection's own buckets cost one uncontended CAS. A
+// zeroed word is a full bucket, so buckets need no initialisation.
+//
+// Per-user and per-group buckets live in an IdTable, a two-level array indexed
+// by the dense IDs from NameTable. Chunks are allocated on first use and
+// published with a CAS, so a lookup is two loads and never blocks.
+
+#ifndef CHAT_RATELIMIT_H
+#define CHAT_RATELIMIT_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#define ID_TABLE_CHUNK 1024
+#define ID_TABLE_CHUNKS 4096
+#define MAX_RATE_BURST (UINT32_MAX / 1000)  // the deficit, in thousandths, must fit in 32 bits
+
+struct RateLimit {
+    uint32_t rate = 0;   // tokens per second; 0 disables the limit
+    uint32_t burst = 0;  // bucket capacity, at most MAX_RATE_BURST
+};
+
+inline uint32_t now_ms() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+class TokenBucket {
+public:
+    // Takes one token if there is one. `now` is now_ms(); it may wrap.
+    bool try_take(const RateLimit &limit, uint32_t now) {
+        if (limit.rate == 0) return true;
+        uint64_t capacity = uint64_t(limit.burst) * 1000;
+        uint64_t state = word.load(std::memory_order_relaxed);
+        while (true) {
+            uint64_t deficit = state >> 32;
+            uint32_t elapsed = now - static_cast<uint32_t>(state);
+            // rate tokens per second refill `rate` thousandths per millisecond.
+            uint64_t refill = uint64_t(elapsed) * limit.rate;
+            deficit = refill >= deficit ? 0 : deficit - refill;
+            if (deficit + 1000 > capacity) return false;
+            uint64_t next = ((deficit + 1000) << 32) | now;
+            if (word.compare_exchange_weak(state, next, std::memory_order_relaxed)) return true;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> word{0};
+};
+
+// Lock-free ID-indexed array of default-constructed T. IDs past
+// ID_TABLE_CHUNK * ID_TABLE_CHUNKS (4M) wrap around and share entries.
+template <typename T>
+class IdTable {
+public:
+    IdTable() = default;
+    IdTable(const IdTable &) = delete;
+    IdTable &operator=(const IdTable &) = delete;
+    ~IdTable() {
+        for (auto &chunk : chunks) delete[] chunk.load();
+    }
+
+    T &operator[](uint32_t id) {
+        id %= ID_TABLE_CHUNK * ID_TABLE_CHUNKS;
+        std::atomic<T *> &slot = chunks[id / ID_TABLE_CHUNK];
+        T *chunk = slot.load(std::memory_order_acquire);
+        if (!chunk) {
+            T *fresh = new T[ID_TABLE_CHUNK]();
+            if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+                chunk = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        return chunk[id % ID_TABLE_CHUNK];
+    }
+
+private:
+    std::array<std::atomic<T *>, ID_TABLE_CHUNKS> chunks{};
+};
+
+#endif // CHAT_RATELIMIT_H
@@ -0,0 +1,346 @@
+// Shared membership state for the chat server: who is online and who is in
+// which group.
+//
+// Everything here is read far more often than it is written (every message
+// looks up a recipient or a group, only logins and joins modify anything), so
+// the structures are built to keep readers off each other's locks:
+//  - ShardedMap splits a hash map into independently locked shards with
+//    shared (reader) locks.
+//  - NameTable interns user and group names into dense 32-bit IDs so the
+//    hot paths hash and compare integers instead of strings.
+//  - Group membership is copy-on-write: fan-out takes a snapshot of the
+//    member list without locking and never blocks a join or leave.
+//  - PrefixIndex is an immutable radix trie over group names, replaced
+//    wholesale on insert, used to resolve "/group_msg <name> <text>".
+// Shard and group locks are TimedLocks, so their wait and hold times show up
+// in the server's metrics.
+
+#ifndef CHAT_REGISTRY_H
+#define CHAT_REGISTRY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "metrics.h"
+
+#define REGISTRY_SHARDS 64
+
+using UserId = uint32_t;
+using GroupId = uint32_t;
+constexpr uint32_t NO_ID = UINT32_MAX;
+
+// Lets string-keyed maps be queried with a string_view without building a key.
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedMap {
+public:
+    using Map = std::conditional_t<std::is_same_v<Hash, StringHash>,
+                                   std::unordered_map<Key, Value, Hash, std::equal_to<>>,
+                                   std::unordered_map<Key, Value, Hash>>;
+
+    // Returns the mapped value, or a default-constructed Value on a miss.
+    template <typename K>
+    Value find(const K &key) const {
+        const Shard &shard = shard_for(key);
+        TimedLock<std::shared_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryRead);
+        auto it = shard.map.find(key);
+        return it == shard.map.end() ? Value() : it->second;
+    }
+
+    // Inserts make() under key unless the key is already present. Returns the
+    // value now stored and whether it was inserted.
+    template <typename K, typename Make>
+    std::pair<Value, bool> find_or_insert(const K &key, Make make) {
+        Shard &shard = shard_for(key);
+        {
+            TimedLock<std::shared_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryRead);
+            auto it = shard.map.find(key);
+            if (it != shard.map.end()) return {it->second, false};
+        }
+        TimedLock<std::unique_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryWrite);
+        auto it = shard.map.find(key);
+        if (it != shard.map.end()) return {it->second, false};
+        Value value = make();
+        shard.map.emplace(Key(key), value);
+        return {value, true};
+    }
+
+    void insert_or_assign(const Key &key, Value value) {
+        Shard &shard = shard_for(key);
+        TimedLock<std::unique_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryWrite);
+        shard.map.insert_or_assign(key, std::move(value));
+    }
+
+    // Erases key only while it still maps to expected, so a stale owner cannot
+    // remove an entry that has since been replaced.
+    bool erase_if_equal(const Key &key, const Value &expected) {
+        Shard &shard = shard_for(key);
+        TimedLock<std::unique_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryWrite);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end() || !(it->second == expected)) return false;
+        shard.map.erase(it);
+        return true;
+    }
+
+    // Visits every entry, one shard at a time under its shared lock.
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const Shard &shard : shards) {
+            TimedLock<std::shared_lock<std::shared_mutex>> lock(shard.mutex, LockSite::RegistryRead);
+            for (const auto &entry : shard.map) fn(entry.first, entry.second);
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        Map map;
+    };
+
+    template <typename K>
+    Shard &shard_for(const K &key) { return shards[Hash{}(key) % REGISTRY_SHARDS]; }
+    template <typename K>
+    const Shard &shard_for(const K &key) const { return shards[Hash{}(key) % REGISTRY_SHARDS]; }
+
+    std::array<Shard, REGISTRY_SHARDS> shards;
+};
+
+// Maps names to dense IDs and back. IDs are never reused.
+class NameTable {
+public:
+    uint32_t intern(std::string_view name) {
+        return *ids.find_or_insert(name, [&]() -> std::optional<uint32_t> {
+            std::unique_lock<std::shared_mutex> lock(names_mutex);
+            names.emplace_back(name);
+            return static_cast<uint32_t>(names.size() - 1);
+        }).first;
+    }
+
+    // Returns NO_ID for a name that was never interned.
+    uint32_t find(std::string_view name) const {
+        auto entry = ids.find(name);
+        return entry ? *entry : NO_ID;
+    }
+
+    std::string name(uint32_t id) const {
+        std::shared_lock<std::shared_mutex> lock(names_mutex);
+        return id < names.size() ? names[id] : std::string();
+    }
+
+private:
+    ShardedMap<std::string, std::optional<uint32_t>, StringHash> ids;
+    mutable std::shared_mutex names_mutex;
+    std::vector<std::string> names;
+};
+
+// A set of dense IDs stored as a bitmap, which grows to the largest ID
+// inserted. Not thread-safe.
+class IdSet {
+public:
+    // Returns true if id was not already present.
+    bool insert(uint32_t id) {
+        size_t word = id / 64;
+        uint64_t bit = uint64_t(1) << (id % 64);
+        if (word >= bits.size()) bits.resize(word + 1);
+        if (bits[word] & bit) return false;
+        bits[word] |= bit;
+        return true;
+    }
+    void clear() { bits.clear(); }
+
+private:
+    std::vector<uint64_t> bits;
+};
+
+// One chat group. Writers copy the member list under write_mutex and publish
+// the copy atomically; readers load the current snapshot and iterate it with
+// no lock held.
+template <typename Member>
+struct Group {
+    using MemberList = std::vector<std::shared_ptr<Member>>;
+
+    GroupId id;
+    std::string name;
+    std::mutex write_mutex;
+    std::atomic<std::shared_ptr<const MemberList>> members{std::make_shared<const MemberList>()};
+
+    Group(GroupId id, std::string_view name) : id(id), name(name) {}
+
+    std::shared_ptr<const MemberList> snapshot() const { return members.load(std::memory_order_acquire); }
+
+    void add(const std::shared_ptr<Member> &member) {
+        TimedLock<std::unique_lock<std::mutex>> lock(write_mutex, LockSite::GroupWrite);
+        auto next = std::make_shared<MemberList>(*members.load(std::memory_order_relaxed));
+        next->push_back(member);
+        members.store(std::move(next), std::memory_order_release);
+    }
+
+    void remove(const Member *member) {
+        TimedLock<std::unique_lock<std::mutex>> lock(write_mutex, LockSite::GroupWrite);
+        const MemberList &current = *members.load(std::memory_order_relaxed);
+        auto next = std::make_shared<MemberList>();
+        next->reserve(current.size());
+        for (const auto &m : current) {
+            if (m.get() != member) next->push_back(m);
+        }
+        members.store(std::move(next), std::memory_order_release);
+    }
+};
+
+// Radix trie mapping names to values, answering "which stored name is the
+// longest prefix of this text, ending at a space or at the end of the text".
+// Nodes are immutable: an insert copies the path from the root to the changed
+// node and publishes the new root atomically. A lookup loads the root once and
+// walks plain pointers with no lock, in O(length of the matched name).
+template <typename Value>
+class PrefixIndex {
+public:
+    struct Match {
+        Value value{};
+        size_t length = 0;
+    };
+
+    void insert(std::string_view key, Value value) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        root.store(insert_at(*root.load(std::memory_order_relaxed), key, value), std::memory_order_release);
+    }
+
+    // Returns the value of the longest stored key k such that text starts with
+    // k and text[k.size()] is a space or the end of text; value is
+    // default-constructed if there is none.
+    Match longest_token_prefix(std::string_view text) const {
+        std::shared_ptr<const Node> snapshot = root.load(std::memory_order_acquire);
+        const Node *node = snapshot.get();
+        Match best;
+        size_t pos = 0;
+        while (true) {
+            if (node->has_value && (pos == text.size() || text[pos] == ' ')) {
+                best.value = node->value;
+                best.length = pos;
+            }
+            if (pos == text.size()) break;
+            const Node *child = node->child(text[pos]);
+            if (!child || text.substr(pos, child->edge.size()) != child->edge) break;
+            pos += child->edge.size();
+            node = child;
+        }
+        return best;
+    }
+
+private:
+    struct Node {
+        std::string edge;  // label on the edge into this node
+        bool has_value = false;
+        Value value{};
+        std::vector<std::shared_ptr<const Node>> children;  // sorted by edge[0]
+
+        const Node *child(char first) const {
+            auto it = std::lower_bound(children.begin(), children.end(), first,
+                                       [](const auto &c, char ch) { return c->edge[0] < ch; });
+            return (it != children.end() && (*it)->edge[0] == first) ? it->get() : nullptr;
+        }
+    };
+
+    // Returns a copy of node with key (relative to node) mapped to value.
+    static std::shared_ptr<const Node> insert_at(const Node &node, std::string_view key, const Value &value) {
+        auto copy = std::make_shared<Node>(node);
+        if (key.empty()) {
+            copy->has_value = true;
+            copy->value = value;
+            return copy;
+        }
+
+        auto it = std::lower_bound(copy->children.begin(), copy->children.end(), key[0],
+                                   [](const auto &c, char ch) { return c->edge[0] < ch; });
+        if (it == copy->children.end() || (*it)->edge[0] != key[0]) {
+            auto leaf = std::make_shared<Node>();
+            leaf->edge = key;
+            leaf->has_value = true;
+            leaf->value = value;
+            copy->children.insert(it, std::move(leaf));
+            return copy;
+        }
+
+        const Node &child = **it;
+        size_t common = 0;
+        while (common < child.edge.size() && common < key.size() && child.edge[common] == key[common]) ++common;
+
+        if (common == child.edge.size()) {
+            *it = insert_at(child, key.substr(common), value);
+            return copy;
+        }
+
+        // Split the child's edge at the first mismatch.
+        auto tail = std::make_shared<Node>(child);
+        tail->edge = child.edge.substr(common);
+        auto mid = std::make_shared<Node>();
+        mid->edge = child.edge.substr(0, common);
+        mid->children.push_back(std::move(tail));
+        *it = insert_at(*mid, key.substr(common), value);
+        return copy;
+    }
+
+    std::mutex write_mutex;
+    std::atomic<std::shared_ptr<const Node>> root{std::make_shared<const Node>()};
+};
+
+// All groups, indexed by interned ID. Groups are never deleted, so a Group*
+// obtained from the registry stays valid for the life of the server.
+template <typename Member>
+class GroupRegistry {
+public:
+    // Returns nullptr if a group with this name already exists.
+    Group<Member> *create(std::string_view name) {
+        GroupId id = names.intern(name);
+        auto [group, inserted] = by_id.find_or_insert(id, [&] {
+            std::lock_guard<std::mutex> lock(storage_mutex);
+            storage.push_back(std::make_unique<Group<Member>>(id, name));
+            return storage.back().get();
+        });
+        if (!inserted) return nullptr;
+        prefixes.insert(name, group);
+        return group;
+    }
+
+    // Resolves the group named at the start of "<group name> <message>".
+    // Group names may contain spaces, so this picks the longest name that
+    // ends at a word boundary.
+    Group<Member> *find_prefix(std::string_view text) const {
+        return prefixes.longest_token_prefix(text).value;
+    }
+
+    Group<Member> *find(std::string_view name) const {
+        GroupId id = names.find(name);
+        return id == NO_ID ? nullptr : by_id.find(id);
+    }
+
+    Group<Member> *get(GroupId id) const { return by_id.find(id); }
+
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        by_id.for_each([&](GroupId, Group<Member> *group) { fn(*group); });
+    }
+
+private:
+    NameTable names;
+    ShardedMap<GroupId, Group<Member> *> by_id;
+    PrefixIndex<Group<Member> *> prefixes;
+    std::mutex storage_mutex;
+    std::vector<std::unique_ptr<Group<Member>>> storage;
+};
+
+#endif // CHAT_REGISTRY_H
@@ -2,299 +2,1761 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <optional>
 #include <vector>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 #include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <cerrno>
+#include <charconv>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <csignal>
 #include <unistd.h>
+#include "framing.h"
+#include "registry.h"
+#include "message_log.h"
+#include "credentials.h"
+#include "cluster.h"
+#include "metrics.h"
+#include "uring.h"
+#include "ratelimit.h"
+#include "compress.h"
 
 #define PORT 12345
-#define BUFFER_SIZE 1024
+#define READ_CHUNK 4096
+#define MAX_EVENTS 256
+#define MAX_IOV 64
+#define MAX_OUTBOUND_BYTES (1024 * 1024)
+#define OFFLINE_BACKLOG 100
+#define HISTORY_LIMIT 100
+#define AUTH_QUEUE_LIMIT 4096
+#define USERS_RELOAD_INTERVAL_MS 1000
+#define URING_ENTRIES 4096
+#define URING_BUFFERS 1024
+#define URING_BUFFER_GROUP 0
+#define INBOX_LIMIT (64 * READ_CHUNK)
+#define DEFAULT_MAX_MESSAGE 8192
+// A message must fit several times over in an outbound queue.
+#define MAX_MESSAGE_LIMIT (MAX_OUTBOUND_BYTES / 4)
+// Frame room for the command and group name around a message.
+#define COMMAND_OVERHEAD 1024
+
+struct Connection;
+
+// Usernames and password hashes, reloaded when the users file changes
+CredentialStore credentials;
+// Interned usernames; a user keeps the same ID for the life of the server
+NameTable user_names;
+// Mapping from user ID to that user's authenticated connection
+ShardedMap<UserId, std::shared_ptr<Connection>> online;
+// All groups by name and ID, each with a copy-on-write member list
+GroupRegistry<Connection> groups;
+// Durable record of every chat message; null when started with --log-dir=
+MessageLog *message_log = nullptr;
+// Other server instances sharing users and groups; null when running alone
+Cluster *cluster = nullptr;
+// Port clients connect to
+int port = PORT;
+
+// How reactors talk to the kernel: readiness through epoll, or completions
+// through one io_uring per reactor (--io=uring).
+enum class IoBackend { Epoll, Uring };
+IoBackend io_backend = IoBackend::Epoll;
+
+// Where a connection is in the login handshake.
+enum class ConnState { AwaitUsername, AwaitPassword, Authenticating, Authenticated, Closed };
+
+// Outcome of a password check, published by the auth pool to the connection.
+enum class AuthResult { Pending, Accepted, Rejected };
+
+// Scheduling token values for Connection::sched. A connection is serviced by
+// at most one worker at a time; readiness events that arrive while a worker
+// owns it are recorded as Dirty so the worker goes round again.
+enum SchedState { Idle = 0, Scheduled = 1, Dirty = 2 };
+
+// What to do with a client whose outbound queue is already MAX_OUTBOUND_BYTES
+// deep because it is not reading: drop the new message, disconnect it, or
+// collapse everything still queued into a single "messages skipped" notice.
+enum class SlowConsumerPolicy { Drop, Disconnect, Coalesce };
+SlowConsumerPolicy slow_consumer_policy = SlowConsumerPolicy::Drop;
+
+// Commands are rate limited per user and per class, so a client can chat
+// freely while its broadcasts, which reach everyone, stay rare.
+enum class CommandClass { Private, Broadcast, Group, Other, Count };
+constexpr int COMMAND_CLASSES = static_cast<int>(CommandClass::Count);
+
+// Token-bucket limits, set from --rate-limit; a rate of 0 turns one off.
+// Every frame, logins included, counts against the connection limit. A
+// throttled command costs a strike; a client out of strikes is disconnected.
+struct RateLimits {
+    RateLimit connection{50, 100};
+    std::array<RateLimit, COMMAND_CLASSES> commands{{{20, 40}, {2, 10}, {20, 40}, {10, 30}}};
+    RateLimit group{100, 200};  // messages into one group, from all its senders on this node
+    RateLimit strikes{1, 10};
+    size_t max_message = DEFAULT_MAX_MESSAGE;  // bytes per /msg, /broadcast or /group_msg
+};
+RateLimits rate_limits;
+// Largest frame a client may send, raised with --max-message.
+size_t max_frame_size = MAX_FRAME_SIZE;
+// Buckets per user for each command class, and per group; they outlive connections.
+IdTable<std::array<TokenBucket, COMMAND_CLASSES>> user_buckets;
+IdTable<TokenBucket> group_buckets;
+
+// Outbound messages are immutable and refcounted so one encoded buffer can
+// sit in many connections' queues at once.
+using Message = std::shared_ptr<const std::string>;
 
-// Mapping from client socket to username
-std::unordered_map<int, std::string> clients; 
-// Mapping from username to password (loaded from users.txt)
-std::unordered_map<std::string, std::string> users; 
-// Mapping from group name to set of client sockets
-std::unordered_map<std::string, std::unordered_set<int>> groups; 
-std::mutex clients_mutex, groups_mutex;
+struct Reactor;
 
-void load_users() {
-    std::ifstream file("users.txt");
-    std::string line, username, password;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        if (std::getline(iss, username, ':') && std::getline(iss, password)) {
-            users[username] = password;
+// A SENDMSG in flight on the io_uring backend; the kernel reads the header and
+// iovecs until the send completes.
+struct UringSend {
+    msghdr msg{};
+    iovec iov[MAX_IOV];
+};
+
+// Per-socket state. Owned by the reactor's connection table; the socket is
+// closed when the last reference goes away, so an fd is never reused while
+// a worker may still be writing to it.
+struct Connection : std::enable_shared_from_this<Connection> {
+    int fd;
+    Reactor *reactor;
+    ConnState state = ConnState::AwaitUsername;
+    std::string username;
+    UserId user_id = NO_ID;
+    std::atomic<int> sched{Idle};
+    // Only touched by the worker that holds the scheduling token.
+    InputBuffer in;
+    FrameParser parser;
+    std::unordered_set<GroupId> joined;
+    std::atomic<AuthResult> auth_result{AuthResult::Pending};
+    TokenBucket frame_bucket;
+    TokenBucket strike_bucket;
+
+    // Outbound queue, flushed by the owning reactor. out_offset is how much of
+    // the front message has already been written.
+    std::mutex out_mutex;
+    std::deque<Message> out_queue;
+    size_t out_offset = 0;
+    size_t out_bytes = 0;
+    size_t skipped = 0;
+    bool out_closed = false;
+    std::atomic<bool> flush_pending{false};
+    // Binary mode: IDs whose names this client has been sent. Guarded by out_mutex.
+    IdSet announced_users;
+    IdSet announced_groups;
+
+    // io_uring backend only. The reactor receives into `inbox` and workers
+    // read from it instead of the socket. send_inflight counts the messages at
+    // the front of out_queue that the kernel is still sending.
+    std::mutex inbox_mutex;
+    std::string inbox;
+    size_t inbox_offset = 0;
+    bool inbox_eof = false;
+    size_t send_inflight = 0;
+    std::unique_ptr<UringSend> send_op;
+    bool recv_armed = false;  // reactor thread only
+    std::atomic<bool> recv_paused{false};
+    std::atomic<bool> closed{false};
+
+    Connection(int fd, Reactor *reactor) : fd(fd), reactor(reactor) { parser.max_frame = max_frame_size; }
+    ~Connection() { close(fd); }
+};
+
+// One epoll instance (or io_uring, created on the reactor's own thread) with
+// its own SO_REUSEPORT listening socket, opened once main has checked that no
+// other listener holds the port. The kernel spreads incoming connections
+// across reactors; each reactor accepts, hands readable sockets to the worker
+// pool and flushes outbound queues, but never runs commands itself.
+// Workers queue connections with pending output on flush_list and wake the
+// reactor through wake_fd.
+struct Reactor {
+    int epoll_fd = -1;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    std::mutex conns_mutex;
+    std::unordered_map<int, std::shared_ptr<Connection>> conns;
+    std::mutex flush_mutex;
+    std::vector<std::shared_ptr<Connection>> flush_list;
+    std::atomic<bool> wake_pending{false};
+};
+
+// Fixed-size pool that runs connection work. Commands for a single connection
+// are always executed in order because a connection is queued at most once.
+// A non-zero max_queue bounds the backlog; try_submit refuses work beyond it.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t num_threads, size_t max_queue = 0) : max_queue(max_queue) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads.emplace_back([this] { run(); });
         }
     }
-}
 
-bool authenticate(int client_socket, const std::string& username, const std::string& password) {
-    auto it = users.find(username);
-    return (it != users.end() && it->second == password);
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    bool try_submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (max_queue && tasks.size() >= max_queue) return false;
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return !tasks.empty(); });
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    size_t max_queue;
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+WorkerPool *workers = nullptr;
+// Runs password hashing, which is slow on purpose, away from the workers.
+WorkerPool *auth_pool = nullptr;
+
+// Hands a connection with pending output to its reactor. Each connection is
+// on a flush list at most once and each reactor is woken at most once per
+// batch, so a fan-out costs one enqueue per recipient and no syscalls beyond
+// a handful of eventfd writes.
+void request_flush(const std::shared_ptr<Connection> &conn) {
+    if (conn->flush_pending.exchange(true)) return;
+    Reactor *reactor = conn->reactor;
+    {
+        std::lock_guard<std::mutex> lock(reactor->flush_mutex);
+        reactor->flush_list.push_back(conn);
+    }
+    if (!reactor->wake_pending.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t ignored = write(reactor->wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
 }
 
-void broadcast_message(int sender_socket, const std::string& message) {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    for (const auto& client : clients) {
-        if (client.first != sender_socket) {
-            send(client.first, message.c_str(), message.length(), 0);
+// Drops `sent` bytes from the front of the outbound queue. Caller holds out_mutex.
+void consume_sent_locked(Connection &conn, size_t sent) {
+    increment(Counter::BytesOut, sent);
+    while (sent > 0) {
+        size_t front_left = conn.out_queue.front()->size() - conn.out_offset;
+        if (sent < front_left) {
+            conn.out_offset += sent;
+            break;
         }
+        sent -= front_left;
+        conn.out_bytes -= conn.out_queue.front()->size();
+        conn.out_queue.pop_front();
+        conn.out_offset = 0;
+    }
+    if (conn.out_queue.empty()) conn.skipped = 0;
+}
+
+// Empties the outbound queue, except for messages the kernel is still sending
+// from. Caller holds out_mutex.
+void clear_queue_locked(Connection &conn) {
+    while (conn.out_queue.size() > conn.send_inflight) {
+        conn.out_bytes -= conn.out_queue.back()->size();
+        conn.out_queue.pop_back();
     }
+    if (conn.out_queue.empty()) conn.out_offset = 0;
 }
 
-void private_message(int sender_socket, const std::string& recipient, const std::string& message) {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    for (const auto& client : clients) {
-        if (client.second == recipient) {
-            std::string formatted_message = "[" + clients[sender_socket] + "]: " + message;
-            send(client.first, formatted_message.c_str(), formatted_message.length(), 0);
+// Writes as much of the outbound queue as the socket accepts, batching up to
+// MAX_IOV messages per sendmsg. Caller holds out_mutex. Does nothing while an
+// io_uring send is in flight, which would be overtaken.
+void flush_locked(Connection &conn) {
+    if (conn.send_inflight) return;
+    while (!conn.out_queue.empty()) {
+        iovec iov[MAX_IOV];
+        size_t count = 0;
+        size_t offset = conn.out_offset;
+        for (const Message &message : conn.out_queue) {
+            if (count == MAX_IOV) break;
+            iov[count].iov_base = const_cast<char *>(message->data()) + offset;
+            iov[count].iov_len = message->size() - offset;
+            offset = 0;
+            ++count;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            conn.out_closed = true;
+            clear_queue_locked(conn);
             return;
         }
+        consume_sent_locked(conn, sent);
+    }
+}
+
+// Runs on the reactor thread for queued output; EPOLLOUT resumes it after EAGAIN.
+void flush_connection(Connection &conn) {
+    TimedLock<std::unique_lock<std::mutex>> lock(conn.out_mutex, LockSite::OutboundQueue);
+    flush_locked(conn);
+}
+
+// A message for one or more clients. Chat messages keep their sender and
+// group apart from the text so binary clients receive IDs; anything else is a
+// Text notice. The views must outlive the delivery.
+struct Delivery {
+    Opcode kind = Opcode::Text;  // Text, Private, Broadcast or Group
+    UserId sender = NO_ID;
+    GroupId group = NO_ID;
+    std::string_view sender_name = {};
+    std::string_view group_name = {};
+    std::string_view text = {};
+};
+
+// The delivery as text clients see it, e.g. "[Group g][alice]: hi".
+std::string format_delivery(const Delivery &delivery) {
+    switch (delivery.kind) {
+    case Opcode::Private:
+    case Opcode::Broadcast:
+        return "[" + std::string(delivery.sender_name) + "]: " + std::string(delivery.text);
+    case Opcode::Group:
+        return "[Group " + std::string(delivery.group_name) + "][" + std::string(delivery.sender_name) +
+               "]: " + std::string(delivery.text);
+    default:
+        return std::string(delivery.text);
+    }
+}
+
+// One delivery encoded lazily per wire mode, so a fan-out formats and
+// allocates each encoding at most once however many recipients share it.
+// That includes the compressed binary frame: a large message is deflated
+// once per fan-out, not once per recipient.
+class SharedFrame {
+public:
+    explicit SharedFrame(const Delivery &delivery) : delivery(delivery) {}
+
+    const Delivery &message() const { return delivery; }
+
+    // The text rendering, also what is forwarded to other cluster nodes.
+    const std::string &text() {
+        if (!formatted) formatted = format_delivery(delivery);
+        return *formatted;
+    }
+
+    // UserName and GroupName frames for the delivery's IDs, likewise shared.
+    const Message &user_name() {
+        if (!user_name_frame) {
+            user_name_frame = std::make_shared<const std::string>(
+                encode_binary(Opcode::UserName, {delivery.sender}, delivery.sender_name));
+        }
+        return user_name_frame;
+    }
+    const Message &group_name() {
+        if (!group_name_frame) {
+            group_name_frame = std::make_shared<const std::string>(
+                encode_binary(Opcode::GroupName, {delivery.group}, delivery.group_name));
+        }
+        return group_name_frame;
+    }
+
+    // The binary frame compressed, or the plain one if it does not shrink.
+    const Message &deflated_frame() {
+        if (deflated) return deflated;
+        const Message &plain = for_mode(FrameMode::Binary);
+        std::string packed = deflate_payload(std::string_view(*plain).substr(FRAME_HEADER_SIZE));
+        if (packed.empty()) {
+            deflated = plain;
+        } else {
+            increment(Counter::DeflatedFrames);
+            deflated = std::make_shared<const std::string>(std::move(packed));
+        }
+        return deflated;
+    }
+
+    const Message &for_connection(const Connection &conn) {
+        if (conn.parser.deflate) {
+            const Message &frame = deflated_frame();
+            if (frame != frames[static_cast<int>(FrameMode::Binary)]) {
+                increment(Counter::DeflateSavedBytes, frames[static_cast<int>(FrameMode::Binary)]->size() - frame->size());
+            }
+            return frame;
+        }
+        return for_mode(conn.parser.mode);
+    }
+
+    const Message &for_mode(FrameMode mode) {
+        Message &frame = frames[static_cast<int>(mode)];
+        if (frame) return frame;
+        if (mode != FrameMode::Binary) {
+            frame = std::make_shared<const std::string>(encode_frame(mode, text()));
+        } else if (delivery.kind == Opcode::Group) {
+            frame = std::make_shared<const std::string>(
+                encode_binary(Opcode::Group, {delivery.group, delivery.sender}, delivery.text));
+        } else if (delivery.kind != Opcode::Text) {
+            frame = std::make_shared<const std::string>(encode_binary(delivery.kind, {delivery.sender}, delivery.text));
+        } else {
+            frame = std::make_shared<const std::string>(encode_binary(Opcode::Text, {}, delivery.text));
+        }
+        return frame;
+    }
+
+private:
+    Delivery delivery;
+    std::optional<std::string> formatted;
+    Message frames[FRAME_MODES];
+    Message deflated;
+    Message user_name_frame, group_name_frame;
+};
+
+// Queues a UserName or GroupName frame ahead of the first binary frame that
+// uses an ID this client has not seen. Caller holds out_mutex.
+void announce_names_locked(Connection &conn, SharedFrame &frame) {
+    if (conn.parser.mode != FrameMode::Binary) return;
+    const Delivery &delivery = frame.message();
+    auto push = [&](const Message &name) {
+        conn.out_bytes += name->size();
+        conn.out_queue.push_back(name);
+    };
+    if (delivery.group != NO_ID && conn.announced_groups.insert(delivery.group)) push(frame.group_name());
+    if (delivery.sender != NO_ID && conn.announced_users.insert(delivery.sender)) push(frame.user_name());
+}
+
+// Appends an encoded message to a connection's outbound queue, applying the
+// slow-consumer policy when the queue is full. `names`, if given, is the
+// delivery the message encodes, whose IDs a binary client may need named first.
+void queue_message(Connection &conn, const Message &message, SharedFrame *names = nullptr) {
+    size_t depth;
+    {
+        TimedLock<std::unique_lock<std::mutex>> lock(conn.out_mutex, LockSite::OutboundQueue);
+        if (conn.out_closed) return;
+        if (conn.out_bytes + message->size() > MAX_OUTBOUND_BYTES) {
+            // The reactor may just be behind; only a socket that is itself
+            // full counts as a slow consumer.
+            flush_locked(conn);
+        }
+        if (conn.out_closed) return;
+        if (conn.out_bytes + message->size() > MAX_OUTBOUND_BYTES) {
+            switch (slow_consumer_policy) {
+            case SlowConsumerPolicy::Drop:
+                increment(Counter::MessagesDropped);
+                return;
+            case SlowConsumerPolicy::Disconnect:
+                increment(Counter::SlowConsumerDisconnects);
+                conn.out_closed = true;
+                clear_queue_locked(conn);
+                // The worker sees EOF and runs the normal disconnect path.
+                shutdown(conn.fd, SHUT_RDWR);
+                return;
+            case SlowConsumerPolicy::Coalesce: {
+                // Keep a partially written front message, and any the kernel
+                // is still sending, so the stream stays well-formed;
+                // everything behind them becomes one notice.
+                size_t keep = std::max<size_t>(conn.out_offset > 0 ? 1 : 0, conn.send_inflight);
+                while (conn.out_queue.size() > keep) {
+                    conn.out_bytes -= conn.out_queue.back()->size();
+                    conn.out_queue.pop_back();
+                    ++conn.skipped;
+                    increment(Counter::MessagesDropped);
+                }
+                // Dropped frames may have named IDs; name them again when next used.
+                conn.announced_users.clear();
+                conn.announced_groups.clear();
+                std::string notice = "[server]: " + std::to_string(conn.skipped) +
+                                     " messages skipped because you are reading too slowly.";
+                auto framed = std::make_shared<const std::string>(encode_frame(conn.parser.mode, notice));
+                conn.out_bytes += framed->size();
+                conn.out_queue.push_back(std::move(framed));
+                if (conn.out_bytes + message->size() > MAX_OUTBOUND_BYTES) {
+                    increment(Counter::MessagesDropped);
+                    return;
+                }
+                break;
+            }
+            }
+        }
+        if (names) announce_names_locked(conn, *names);
+        conn.out_bytes += message->size();
+        conn.out_queue.push_back(message);
+        depth = conn.out_bytes;
+    }
+    increment(Counter::MessagesQueued);
+    observe(Metric::QueueDepthBytes, depth);
+    request_flush(conn.shared_from_this());
+}
+
+// Sends one message to a client, framed for the mode it connected with. The
+// mode is fixed before a client is authenticated, so other workers may read
+// it once the client is visible in `online` or a group.
+void send_message(Connection &conn, std::string_view message) {
+    queue_message(conn, std::make_shared<const std::string>(encode_frame(conn.parser.mode, message)));
+}
+
+void queue_delivery(Connection &conn, SharedFrame &frame) {
+    queue_message(conn, frame.for_connection(conn), &frame);
+}
+
+
+
+// Polls the users file and swaps in a new credential table when it changes.
+void watch_users_file(std::string path) {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(USERS_RELOAD_INTERVAL_MS));
+        if (credentials.reload_if_changed()) {
+            std::cout << "Reloaded " << credentials.snapshot()->size() << " users from " << path << std::endl;
+        }
+    }
+}
+
+// Runs on the auth pool.
+bool authenticate(std::string_view username, std::string_view password) {
+    return credentials.snapshot()->verify(username, password);
+}
+
+// Sends a message to every client on this node except `exclude`.
+void deliver_broadcast(const Connection *exclude, SharedFrame &frame) {
+    size_t recipients = 0;
+    online.for_each([&](UserId, const std::shared_ptr<Connection> &client) {
+        if (client.get() != exclude) {
+            queue_delivery(*client, frame);
+            ++recipients;
+        }
+    });
+    observe(Metric::FanoutSize, recipients);
+}
+
+void broadcast_message(Connection &sender, const Delivery &delivery) {
+    SharedFrame frame(delivery);
+    deliver_broadcast(&sender, frame);
+    if (cluster) cluster->forward_broadcast(frame.text());
+}
+
+void broadcast_chat(Connection &sender, std::string_view message) {
+    broadcast_message(sender, {.kind = Opcode::Broadcast, .sender = sender.user_id, .sender_name = sender.username,
+                               .text = message});
+    if (message_log) message_log->append(RecordKind::Broadcast, "", sender.username, message);
+}
+
+// Renders a logged message the way it was shown when it was delivered live.
+std::string format_record(const LogRecord &record) {
+    if (record.kind == RecordKind::Group) {
+        return "[Group " + record.target + "][" + record.sender + "]: " + record.payload;
     }
-    send(sender_socket, "ERROR: User not found or not online.", 36, 0);
+    return "[" + record.sender + "]: " + record.payload;
 }
 
-void join_group(int client_socket, const std::string& group_name) {
-    std::lock_guard<std::mutex> lock(groups_mutex);
-    if (groups.find(group_name) != groups.end()) {
-        groups[group_name].insert(client_socket);
-        std::string reply = "You joined the group " + group_name + ".";
-        send(client_socket, reply.c_str(), reply.length(), 0);
+void private_message(Connection &sender, std::string_view recipient, std::string_view message) {
+    UserId recipient_id = user_names.find(recipient);
+    std::shared_ptr<Connection> client = recipient_id == NO_ID ? nullptr : online.find(recipient_id);
+    if (client) {
+        SharedFrame frame({.kind = Opcode::Private, .sender = sender.user_id, .sender_name = sender.username,
+                           .text = message});
+        queue_delivery(*client, frame);
+        if (message_log) message_log->append(RecordKind::Private, recipient, sender.username, message);
+        return;
+    }
+    // Logged in to another node: that node delivers and logs it.
+    if (cluster && cluster->forward_private(recipient, sender.username, message)) return;
+    if (message_log && credentials.snapshot()->contains(recipient)) {
+        // Known user who is not logged in: keep it for their next login.
+        message_log->append(RecordKind::Private, recipient, sender.username, message, RECORD_FLAG_OFFLINE);
+        send_message(sender, "User is offline; message will be delivered at next login.");
+        return;
+    }
+    send_message(sender, "ERROR: User not found or not online.");
+}
+
+void join_group(Connection &conn, std::string_view group_name) {
+    Group<Connection> *group = groups.find(group_name);
+    if (group) {
+        if (conn.joined.insert(group->id).second) {
+            group->add(conn.shared_from_this());
+            if (cluster) cluster->member_joined(group->name, conn.username);
+        }
+        // Binary clients learn the group's ID along with the reply, so they can send to it.
+        std::string reply = "You joined the group " + group->name + ".";
+        SharedFrame frame({.group = group->id, .group_name = group->name, .text = reply});
+        queue_delivery(conn, frame);
     } else {
-        send(client_socket, "ERROR: Group does not exist.", 29, 0);
+        send_message(conn, "ERROR: Group does not exist.");
     }
 }
 
-void leave_group(int client_socket, const std::string& group_name) {
-    std::lock_guard<std::mutex> lock(groups_mutex);
-    if (groups.find(group_name) != groups.end()) {
-        if(groups[group_name].find(client_socket)==groups[group_name].end()){
-            send(client_socket,"ERROR: Group not joined",23,0);
+void leave_group(Connection &conn, std::string_view group_name) {
+    Group<Connection> *group = groups.find(group_name);
+    if (group) {
+        if (conn.joined.erase(group->id) == 0) {
+            send_message(conn, "ERROR: Group not joined");
             return;
         }
-        groups[group_name].erase(client_socket);
-        send(client_socket, "Left group successfully.", 25, 0);
+        group->remove(&conn);
+        if (cluster) cluster->member_left(group->name, conn.username);
+        send_message(conn, "Left group successfully.");
     } else {
-        send(client_socket, "ERROR: Group does not exist.", 29, 0);
+        send_message(conn, "ERROR: Group does not exist.");
     }
 }
 
-void group_message(int sender_socket, const std::string& group_name, const std::string& message) {
-    std::lock_guard<std::mutex> lock(groups_mutex);
-    if (groups.find(group_name) != groups.end()) {
-        std::string formatted_message = "[Group " + group_name + "][" + clients[sender_socket] + "]: " + message;
-        if(groups[group_name].find(sender_socket)==groups[group_name].end()){
-            send(sender_socket,"ERROR: Group not joined",23,0);
+// Sends a formatted message to the group's members on this node except `exclude`.
+void deliver_group(Group<Connection> &group, const Connection *exclude, SharedFrame &frame) {
+    auto members = group.snapshot();
+    size_t recipients = 0;
+    for (const auto &member : *members) {
+        if (member.get() != exclude) {
+            queue_delivery(*member, frame);
+            ++recipients;
+        }
+    }
+    observe(Metric::FanoutSize, recipients);
+}
+
+void group_message(Connection &sender, Group<Connection> &group, std::string_view message) {
+    if (sender.joined.find(group.id) == sender.joined.end()) {
+        send_message(sender, "ERROR: Group not joined");
+        return;
+    }
+    if (!group_buckets[group.id].try_take(rate_limits.group, now_ms())) {
+        increment(Counter::RateLimited);
+        send_message(sender, "ERROR: Group " + group.name + " is receiving too many messages; try again later.");
+        return;
+    }
+    SharedFrame frame({.kind = Opcode::Group, .sender = sender.user_id, .group = group.id,
+                       .sender_name = sender.username, .group_name = group.name, .text = message});
+    deliver_group(group, &sender, frame);
+    if (cluster) cluster->forward_group(group.name, frame.text());
+    if (message_log) message_log->append(RecordKind::Group, group.name, sender.username, message);
+}
+
+// Replays logged messages visible to this client starting at offset `from`:
+// its private messages, its current groups' messages and broadcasts. Ends
+// with the offset to pass to the next /history call.
+void send_history(Connection &conn, uint64_t from) {
+    if (!message_log) {
+        send_message(conn, "ERROR: Message history is disabled.");
+        return;
+    }
+    std::vector<std::string> group_names;
+    for (GroupId group_id : conn.joined) {
+        group_names.push_back(groups.get(group_id)->name);
+    }
+    std::vector<LogRecord> records = message_log->history(conn.username, group_names, from, HISTORY_LIMIT);
+    for (const LogRecord &record : records) {
+        send_message(conn, "[#" + std::to_string(record.offset) + "] " + format_record(record));
+    }
+    uint64_t next = records.empty() ? message_log->next_offset() : records.back().offset + 1;
+    send_message(conn, "End of history; next offset " + std::to_string(next) + ".");
+}
+
+// Prometheus text dump of the server's metrics plus current gauges.
+std::string stats_text() {
+    size_t connections = 0;
+    online.for_each([&](UserId, const std::shared_ptr<Connection> &) { ++connections; });
+    return render_metrics("# TYPE chat_users_online gauge\nchat_users_online " + std::to_string(connections) + "\n");
+}
+
+// Runs one command from an authenticated client. `message` points into the
+// connection's receive buffer and is only valid for the duration of the call.
+void handle_command(Connection &conn, std::string_view message) {
+    if (message.starts_with("/msg")) {
+        // Private message: /msg <username> <message>
+        size_t space1 = message.find(' ');
+        size_t space2 = message.find(' ', space1 + 1);
+        if (space1 != std::string_view::npos && space2 != std::string_view::npos) {
+            std::string_view recipient = message.substr(space1 + 1, space2 - space1 - 1);
+            std::string_view msg = message.substr(space2 + 1);
+            private_message(conn, recipient, msg);
+        }
+    } else if (message.starts_with("/broadcast")) {
+        // Broadcast message: /broadcast <message>
+        std::string_view msg = message.size() > 11 ? message.substr(11) : ""; // Skip "/broadcast " (10 characters + space)
+        broadcast_chat(conn, msg);
+    } else if (message.starts_with("/create_group")) {
+        // Create a new group: /create_group <groupname>
+        size_t pos = message.find(' ');
+        if (pos != std::string_view::npos) {
+            std::string_view group_name = message.substr(pos + 1);
+            Group<Connection> *group = nullptr;
+            if (group_name.size() > MAX_NAME_SIZE) {
+                send_message(conn, "Group name is too long.");
+            } else if (!(group = groups.create(group_name))) {
+                send_message(conn, "Group already exists.");
+            } else {
+                if (cluster) cluster->group_created(group->name);
+                std::string response = "Group " + group->name + " created.";
+                send_message(conn, response);
+            }
+        } else {
+            send_message(conn, "Invalid command format for group creation.");
+        }
+    } else if (message.starts_with("/join_group")) {
+        // Join an existing group: /join_group <groupname>
+        std::string_view group_name = message.size() > 12 ? message.substr(12) : ""; // Skip "/join_group " (11 characters + space)
+        join_group(conn, group_name);
+    } else if (message.starts_with("/group_msg")) {
+        // Send a message to a group: /group_msg <group name> <message>
+        // We need to allow group names with spaces.
+        // First, remove the command prefix.
+        std::string_view args = message.substr(10); // "/group_msg" is 10 characters.
+        // Trim any leading spaces.
+        while (!args.empty() && args.front() == ' ') {
+            args.remove_prefix(1);
+        }
+        if (args.empty()) {
+            send_message(conn, "No group specified.");
+            return;
+        }
+        // Find the longest group name that is a prefix of args and is a full
+        // token (either args equals the group name, or a space follows it).
+        Group<Connection> *matched_group = groups.find_prefix(args);
+        if (!matched_group) {
+            send_message(conn, "Group does not exist.");
+            return;
+        }
+        // Extract the group message: skip the matched group and any following space(s).
+        std::string_view group_msg = args.substr(matched_group->name.size());
+        while (!group_msg.empty() && group_msg.front() == ' ')
+            group_msg.remove_prefix(1);
+        if (group_msg.empty()) {
+            send_message(conn, "No message provided for group message.");
             return;
         }
-        for (int client_socket : groups[group_name]) {
-            if (client_socket != sender_socket) {
-                send(client_socket, formatted_message.c_str(), formatted_message.length(), 0);
+        group_message(conn, *matched_group, group_msg);
+    } else if (message.starts_with("/leave_group")) {
+        // Leave a group: /leave_group <groupname>
+        std::string_view group_name = message.size() > 13 ? message.substr(13) : ""; // Skip "/leave_group " (12 characters + space)
+        leave_group(conn, group_name);
+    } else if (message.starts_with("/history")) {
+        // Replay logged messages: /history [offset]
+        uint64_t from = 0;
+        if (message.size() > 9) {
+            std::string_view arg = message.substr(9);
+            auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), from);
+            if (ec != std::errc() || end != arg.data() + arg.size()) {
+                send_message(conn, "Invalid command format for history.");
+                return;
             }
         }
-    } else {
-        send(sender_socket, "ERROR: Group does not exist.", 29, 0);
+        send_history(conn, from);
+    } else if (message == "/stats") {
+        send_message(conn, stats_text());
+    }
+    else if(message.starts_with("/exit")){
+        std::string left_message = conn.username + " has left the chat.";
+        broadcast_message(conn, {.text = left_message});
     }
+
+    // (Additional commands can be added here.)
 }
 
-void handle_client(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    std::string username, password;
+void schedule(const std::shared_ptr<Connection> &conn);
+
+CommandClass classify(Opcode op, std::string_view input) {
+    if (op == Opcode::SendPrivate || (op == Opcode::Text && input.starts_with("/msg"))) return CommandClass::Private;
+    if (op == Opcode::SendBroadcast || (op == Opcode::Text && input.starts_with("/broadcast"))) {
+        return CommandClass::Broadcast;
+    }
+    if (op == Opcode::SendGroup || (op == Opcode::Text && input.starts_with("/group_msg"))) return CommandClass::Group;
+    return CommandClass::Other;
+}
 
-    // --- Authentication ---
-    send(client_socket, "Enter username: ", 16, 0);
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0);
-    username = std::string(buffer);
-    // Remove any trailing newline characters
-    username.erase(username.find_last_not_of("\n\r") + 1);
+// Runs one binary command other than Text from an authenticated client.
+// Returns false for an opcode a client may not send.
+bool handle_binary_command(Connection &conn, const BinaryFrame &frame) {
+    switch (frame.op) {
+    case Opcode::SendPrivate: {
+        std::string recipient = user_names.name(frame.ids[0]);
+        if (recipient.empty()) {
+            send_message(conn, "ERROR: User not found or not online.");
+        } else {
+            private_message(conn, recipient, frame.text);
+        }
+        return true;
+    }
+    case Opcode::SendBroadcast:
+        broadcast_chat(conn, frame.text);
+        return true;
+    case Opcode::SendGroup:
+        if (Group<Connection> *group = groups.get(frame.ids[0])) {
+            group_message(conn, *group, frame.text);
+        } else {
+            send_message(conn, "Group does not exist.");
+        }
+        return true;
+    default:
+        send_message(conn, "ERROR: Unexpected message type.");
+        return false;
+    }
+}
 
-    send(client_socket, "Enter password: ", 16, 0);
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0);
-    password = std::string(buffer);
-    password.erase(password.find_last_not_of("\n\r") + 1);
+enum class Admission { Allow, Throttle, Disconnect };
 
-    if (!authenticate(client_socket, username, password)) {
-        send(client_socket, "Authentication failed.", 22, 0);
-        close(client_socket);
-        return;
+// Checks one frame against the connection's and, once logged in, the user's
+// rate limits and the message size limit. A refused frame is answered and
+// dropped, and costs a strike.
+Admission admit(Connection &conn, std::string_view input, CommandClass command) {
+    static const char *class_names[COMMAND_CLASSES] = {"/msg", "/broadcast", "/group_msg", "commands"};
+    uint32_t now = now_ms();
+    std::string refusal;
+    if (!conn.frame_bucket.try_take(rate_limits.connection, now)) {
+        refusal = "ERROR: Rate limit exceeded; slow down.";
+    } else if (conn.state == ConnState::Authenticated) {
+        int index = static_cast<int>(command);
+        if (command != CommandClass::Other && input.size() > rate_limits.max_message) {
+            refusal = "ERROR: Message too long; the limit is " + std::to_string(rate_limits.max_message) + " bytes.";
+        } else if (!user_buckets[conn.user_id][index].try_take(rate_limits.commands[index], now)) {
+            refusal = std::string("ERROR: Rate limit exceeded for ") + class_names[index] + "; slow down.";
+        }
+    }
+    if (refusal.empty()) return Admission::Allow;
+    increment(Counter::RateLimited);
+    if (!conn.strike_bucket.try_take(rate_limits.strikes, now)) {
+        increment(Counter::RateLimitDisconnects);
+        send_message(conn, "Disconnected for flooding.");
+        return Admission::Disconnect;
     }
+    send_message(conn, refusal);
+    return Admission::Throttle;
+}
 
-    // Send welcome message to the newly authenticated client.
-    send(client_socket, "Welcome to the chat server!", 27, 0);
+// Advances the login state machine or runs a command for one received frame.
+// Returns false when the connection should be closed.
+bool handle_input(const std::shared_ptr<Connection> &conn, std::string_view input) {
+    BinaryFrame binary{Opcode::Text, {}, input};
+    std::string inflated;
+    if (conn->parser.mode == FrameMode::Binary) {
+        bool ok = decode_binary(input, binary);
+        if (ok && binary.op == Opcode::Deflated) {
+            // Unpack and handle the frame inside; it may not be Deflated again.
+            ok = conn->parser.deflate &&
+                 inflate_payload(binary.ids[0], binary.text, conn->parser.max_frame, inflated) &&
+                 decode_binary(inflated, binary) && binary.op != Opcode::Deflated;
+        }
+        if (!ok || (binary.op != Opcode::Text && conn->state != ConnState::Authenticated)) {
+            send_message(*conn, "ERROR: Malformed or oversized message.");
+            return false;
+        }
+        input = binary.text;
+    }
+    CommandClass command = classify(binary.op, input);
+    switch (admit(*conn, input, command)) {
+    case Admission::Allow:
+        break;
+    case Admission::Throttle:
+        return true;
+    case Admission::Disconnect:
+        return false;
+    }
 
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        clients[client_socket] = username;
+    switch (conn->state) {
+    case ConnState::AwaitUsername:
+        if (input.size() > MAX_NAME_SIZE) {
+            // No account can have it; the message log could not record it
+            send_message(*conn, "Authentication failed.");
+            return false;
+        }
+        conn->username = input;
+        conn->state = ConnState::AwaitPassword;
+        send_message(*conn, "Enter password: ");
+        return true;
+
+    case ConnState::AwaitPassword: {
+        // Frames after the password wait in the buffer until the check is done.
+        conn->state = ConnState::Authenticating;
+        uint64_t submitted = now_ns();
+        bool queued = auth_pool->try_submit([conn, username = conn->username, password = std::string(input), submitted] {
+            bool ok = authenticate(username, password);
+            observe(Metric::AuthLatencyUs, (now_ns() - submitted) / 1000);
+            conn->auth_result.store(ok ? AuthResult::Accepted : AuthResult::Rejected, std::memory_order_release);
+            schedule(conn);
+        });
+        if (!queued) {
+            send_message(*conn, "Server busy, try again later.");
+            return false;
+        }
+        return true;
+    }
+
+    case ConnState::Authenticating:
+        // process_frames leaves frames buffered until the password check is
+        // done; one handed over anyway must not run before the login exists.
+        send_message(*conn, "ERROR: Still authenticating, command dropped.");
+        return true;
+
+    case ConnState::Authenticated: {
+        uint64_t start = now_ns();
+        if (binary.op == Opcode::Text) {
+            handle_command(*conn, input);
+        } else if (!handle_binary_command(*conn, binary)) {
+            return false;
+        }
+        observe(Metric::CommandLatencyNs, now_ns() - start);
+        static const Counter command_counters[COMMAND_CLASSES] = {Counter::CommandMsg, Counter::CommandBroadcast,
+                                                                  Counter::CommandGroupMsg, Counter::CommandOther};
+        increment(command_counters[static_cast<int>(command)]);
+        return true;
+    }
+
+    case ConnState::Closed:
+        break;
+    }
+    return false;
+}
+
+// Completes a login once the auth pool has checked the password. Returns
+// false when the connection should be closed.
+bool finish_login(const std::shared_ptr<Connection> &conn) {
+    if (conn->auth_result.load(std::memory_order_acquire) != AuthResult::Accepted) {
+        increment(Counter::AuthFailures);
+        send_message(*conn, "Authentication failed.");
+        return false;
+    }
+    // One session per user: replacing the entry would leave the first
+    // session connected but unreachable, and its logout would not end the
+    // second's presence.
+    conn->user_id = user_names.intern(conn->username);
+    if (!online.find_or_insert(conn->user_id, [&] { return conn; }).second) {
+        increment(Counter::AuthFailures);
+        send_message(*conn, "User is already logged in.");
+        return false;
     }
+    increment(Counter::AuthSuccesses);
+
+    // Send welcome message to the newly authenticated client.
+    send_message(*conn, "Welcome to the chat server!");
+    if (cluster) cluster->user_online(conn->username);
+    conn->state = ConnState::Authenticated;
 
     // Broadcast to all other clients that this user has joined.
-    broadcast_message(client_socket, username + " has joined the chat.");
+    std::string joined_message = conn->username + " has joined the chat.";
+    broadcast_message(*conn, {.text = joined_message});
 
-    // --- Main loop to process client commands ---
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
+    // Deliver private messages that arrived while the user was away.
+    if (message_log) {
+        for (const LogRecord &record : message_log->take_offline(conn->username, OFFLINE_BACKLOG)) {
+            send_message(*conn, format_record(record));
+        }
+    }
+    return true;
+}
+
+// Feeds every complete frame in the receive buffer to the state machine,
+// pausing while a password check is outstanding. Returns false when the
+// connection should be closed.
+bool process_frames(const std::shared_ptr<Connection> &conn) {
+    std::string_view frame;
+    while (conn->state != ConnState::Authenticating) {
+        switch (conn->parser.next(conn->in, frame)) {
+        case ParseResult::Frame:
+            if (!handle_input(conn, frame)) return false;
             break;
+        case ParseResult::NeedMore:
+            return true;
+        case ParseResult::Error:
+            send_message(*conn, "ERROR: Malformed or oversized message.");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cleanup on disconnect: remove the client from every shared structure, then
+// drop the reactor's reference so the socket is closed.
+void disconnect(const std::shared_ptr<Connection> &conn) {
+    if (conn->state == ConnState::Authenticated) {
+        for (GroupId group_id : conn->joined) {
+            Group<Connection> *group = groups.get(group_id);
+            group->remove(conn.get());
+            if (cluster) cluster->member_left(group->name, conn->username);
         }
+        conn->joined.clear();
+        if (online.erase_if_equal(conn->user_id, conn) && cluster) {
+            cluster->user_offline(conn->username);
+        }
+    }
+    conn->state = ConnState::Closed;
+
+    if (io_backend == IoBackend::Uring) {
+        // The reactor writes out what is still queued and drops the
+        // connection once its receive and send have completed; shutting the
+        // read side down ends the receive.
+        conn->closed.store(true);
+        shutdown(conn->fd, SHUT_RD);
+        request_flush(conn);
+        return;
+    }
+    Reactor *reactor = conn->reactor;
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    std::lock_guard<std::mutex> lock(reactor->conns_mutex);
+    reactor->conns.erase(conn->fd);
+}
 
-        std::string message(buffer);
+// Reads client input: from the socket with epoll, from the inbox the reactor
+// fills with io_uring. Behaves like a non-blocking recv.
+ssize_t receive_input(Connection &conn, char *buf, size_t len) {
+    if (io_backend == IoBackend::Epoll) return recv(conn.fd, buf, len, 0);
+    size_t n;
+    {
+        std::lock_guard<std::mutex> lock(conn.inbox_mutex);
+        size_t available = conn.inbox.size() - conn.inbox_offset;
+        if (available == 0) {
+            if (conn.inbox_eof) return 0;
+            errno = EAGAIN;
+            return -1;
+        }
+        n = std::min(len, available);
+        std::memcpy(buf, conn.inbox.data() + conn.inbox_offset, n);
+        conn.inbox_offset += n;
+        if (conn.inbox_offset < conn.inbox.size()) return n;
+        conn.inbox.clear();
+        conn.inbox_offset = 0;
+    }
+    // Drained: ask the reactor to resume receiving if it had paused.
+    if (conn.recv_paused.load()) request_flush(conn.shared_from_this());
+    return n;
+}
 
-        if (message.starts_with("/msg")) {
-            // Private message: /msg <username> <message>
-            size_t space1 = message.find(' ');
-            size_t space2 = message.find(' ', space1 + 1);
-            if (space1 != std::string::npos && space2 != std::string::npos) {
-                std::string recipient = message.substr(space1 + 1, space2 - space1 - 1);
-                std::string msg = message.substr(space2 + 1);
-                private_message(client_socket, recipient, msg);
+// Worker-side body for a readable connection: drains the socket until EAGAIN
+// (required with edge-triggered epoll) and feeds the data to the frame parser.
+void service_connection(std::shared_ptr<Connection> conn) {
+    // Woken by the auth pool after the client already went away.
+    if (conn->state == ConnState::Closed) return;
+    while (true) {
+        if (conn->state == ConnState::Authenticating &&
+            conn->auth_result.load(std::memory_order_acquire) != AuthResult::Pending) {
+            if (!finish_login(conn) || !process_frames(conn)) {
+                disconnect(conn);
+                return;
             }
-        } else if (message.starts_with("/broadcast")) {
-            // Broadcast message: /broadcast <message>
-            std::string msg = message.substr(11); // Skip "/broadcast " (10 characters + space)
-            broadcast_message(client_socket, "[" + username + "]: " + msg);
-        } else if (message.starts_with("/create_group")) {
-            // Create a new group: /create_group <groupname>
-            size_t pos = message.find(' ');
-            if (pos != std::string::npos) {
-                std::string group_name = message.substr(pos + 1);
-                group_name.erase(group_name.find_last_not_of("\n\r") + 1);
-                std::lock_guard<std::mutex> lock(groups_mutex);
-                if (groups.find(group_name) != groups.end()) {
-                    send(client_socket, "Group already exists.", 23, 0);
-                } else {
-                    groups[group_name] = std::unordered_set<int>();
-                    std::string response = "Group " + group_name + " created.";
-                    send(client_socket, response.c_str(), response.length(), 0);
-                }
-            } else {
-                send(client_socket, "Invalid command format for group creation.", 45, 0);
+        }
+        while (true) {
+            // While the password is being checked, buffer at most one frame's
+            // worth; the auth pool reschedules the connection when it is done.
+            if (conn->state == ConnState::Authenticating && conn->in.readable().size() > conn->parser.max_frame) {
+                break;
             }
-        } else if (message.starts_with("/join_group")) {
-            // Join an existing group: /join_group <groupname>
-            std::string group_name = message.substr(12); // Skip "/join_group " (11 characters + space)
-            group_name.erase(group_name.find_last_not_of("\n\r") + 1);
-            join_group(client_socket, group_name);
-        } else if (message.starts_with("/group_msg")) {
-            // Send a message to a group: /group_msg <group name> <message>
-            // We need to allow group names with spaces.
-            // First, remove the command prefix.
-            std::string args = message.substr(10); // "/group_msg" is 10 characters.
-            // Trim any leading spaces.
-            while (!args.empty() && args.front() == ' ') {
-                args.erase(0, 1);
+            char *space = conn->in.write_space(READ_CHUNK);
+            ssize_t bytes_received = receive_input(*conn, space, conn->in.writable());
+            if (bytes_received > 0) {
+                conn->in.commit(bytes_received);
+                increment(Counter::BytesIn, bytes_received);
+                if (!process_frames(conn)) {
+                    disconnect(conn);
+                    return;
+                }
+                continue;
             }
-            if (args.empty()) {
-                send(client_socket, "No group specified.", 21, 0);
+            if (bytes_received < 0 && errno == EINTR) {
                 continue;
             }
-            // Find the longest matching group name that is a prefix of args.
-            std::string matched_group = "";
-            {
-                std::lock_guard<std::mutex> lock(groups_mutex);
-                for (const auto &entry : groups) {
-                    const std::string &group_name = entry.first;
-                    if (args.size() >= group_name.size() &&
-                        args.compare(0, group_name.size(), group_name) == 0) {
-                        // Ensure the group name is a full token (either args equals the group name,
-                        // or the character following it is a space)
-                        if (args.size() == group_name.size() || args[group_name.size()] == ' ') {
-                            if (group_name.size() > matched_group.size()) {
-                                matched_group = group_name;
-                            }
-                        }
-                    }
-                }
+            if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
             }
-            if (matched_group.empty()) {
-                send(client_socket, "Group does not exist.", 22, 0);
+            disconnect(conn);
+            return;
+        }
+        conn->in.shrink_if_idle(0);
+
+        // Give the connection back unless the reactor saw new data meanwhile.
+        int expected = Scheduled;
+        if (conn->sched.compare_exchange_strong(expected, Idle)) {
+            return;
+        }
+        conn->sched.store(Scheduled);
+    }
+}
+
+void schedule(const std::shared_ptr<Connection> &conn) {
+    int prev = conn->sched.load();
+    while (true) {
+        int next = (prev == Idle) ? Scheduled : Dirty;
+        if (conn->sched.compare_exchange_weak(prev, next)) {
+            break;
+        }
+    }
+    if (prev == Idle) {
+        workers->submit([conn] { service_connection(conn); });
+    }
+}
+
+// Chat frames are small and the send path already coalesces them into one
+// writev, so Nagle's algorithm would only hold them back until the client's
+// delayed ACK.
+void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+void accept_clients(Reactor &reactor) {
+    static const Message greeting = std::make_shared<const std::string>(GREETING);
+    while (true) {
+        sockaddr_in client_addr{};
+        socklen_t client_len = sizeof(client_addr);
+        int client_socket = accept4(reactor.listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
                 continue;
             }
-            // Extract the group message: skip the matched group and any following space(s).
-            std::string group_msg = "";
-            if (args.size() > matched_group.size()) {
-                group_msg = args.substr(matched_group.size());
-                while (!group_msg.empty() && group_msg.front() == ' ')
-                    group_msg.erase(0, 1);
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Error accepting client connection." << std::endl;
+            }
+            return;
+        }
+
+        set_nodelay(client_socket);
+        increment(Counter::Accepts);
+        auto conn = std::make_shared<Connection>(client_socket, &reactor);
+        {
+            std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+            reactor.conns[client_socket] = conn;
+        }
+        queue_message(*conn, greeting);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = client_socket;
+        if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+            std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+            reactor.conns.erase(client_socket);
+        }
+    }
+}
+
+// Flushes every connection that workers queued output for since the last wakeup.
+void flush_pending_connections(Reactor &reactor) {
+    uint64_t count;
+    ssize_t ignored = read(reactor.wake_fd, &count, sizeof(count));
+    (void)ignored;
+    reactor.wake_pending.store(false);
+
+    std::vector<std::shared_ptr<Connection>> pending;
+    {
+        std::lock_guard<std::mutex> lock(reactor.flush_mutex);
+        pending.swap(reactor.flush_list);
+    }
+    for (auto &conn : pending) {
+        conn->flush_pending.store(false);
+        flush_connection(*conn);
+    }
+}
+
+void run_reactor(Reactor &reactor) {
+    epoll_event events[MAX_EVENTS];
+    while (true) {
+        int n = epoll_wait(reactor.epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error waiting for events." << std::endl;
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == reactor.listen_fd) {
+                accept_clients(reactor);
+                continue;
             }
-            if (group_msg.empty()) {
-                send(client_socket, "No message provided for group message.", 40, 0);
+            if (fd == reactor.wake_fd) {
+                flush_pending_connections(reactor);
                 continue;
             }
-            group_message(client_socket, matched_group, group_msg);
-        } else if (message.starts_with("/leave_group")) {
-            // Leave a group: /leave_group <groupname>
-            std::string group_name = message.substr(13); // Skip "/leave_group " (12 characters + space)
-            group_name.erase(group_name.find_last_not_of("\n\r") + 1);
-            leave_group(client_socket, group_name);
-        }
-        else if(message.starts_with("/exit")){
-            // std::lock_guard<std::mutex> lock(clients_mutex);
-            std::string left_message = clients[client_socket] + " has left the chat.";
-            broadcast_message(client_socket, left_message);
-            // clients.erase(client_socket);
-            // close(client_socket);
-            // return;
-        }
-        
-        // (Additional commands can be added here.)
-    }
-
-    // Cleanup on disconnect: remove client and broadcast leaving message.
+            std::shared_ptr<Connection> conn;
+            {
+                std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+                auto it = reactor.conns.find(fd);
+                if (it == reactor.conns.end()) continue;
+                conn = it->second;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush_connection(*conn);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                schedule(conn);
+            }
+        }
+    }
+}
+
+// io_uring reactor. Every operation is tagged with its kind and fd; the
+// connection is looked up again when it completes.
+enum UringOp : uint64_t { OpAccept = 1, OpWake, OpRecv, OpSend, OpCancel };
+
+uint64_t uring_tag(UringOp op, int fd) { return (uint64_t(op) << 32) | uint32_t(fd); }
+
+// An SQE, submitting what is queued so far if the ring is full.
+io_uring_sqe *next_sqe(Ring &ring) {
+    io_uring_sqe *sqe;
+    while (!(sqe = ring.get_sqe())) ring.submit_and_wait(0);
+    return sqe;
+}
+
+void arm_accept(Reactor &reactor, Ring &ring) {
+    io_uring_sqe *sqe = next_sqe(ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor.listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = uring_tag(OpAccept, reactor.listen_fd);
+}
+
+void arm_wake(Reactor &reactor, Ring &ring) {
+    io_uring_sqe *sqe = next_sqe(ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reactor.wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = uring_tag(OpWake, reactor.wake_fd);
+}
+
+// One multishot receive per connection; each completion brings a provided buffer.
+void arm_recv(Ring &ring, Connection &conn) {
+    io_uring_sqe *sqe = next_sqe(ring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ring.group();
+    sqe->user_data = uring_tag(OpRecv, conn.fd);
+    conn.recv_armed = true;
+}
+
+// Re-arms a finished receive unless the client is gone or has not yet
+// consumed what was received before the pause.
+void resume_recv(Ring &ring, Connection &conn) {
+    if (conn.recv_armed || conn.closed.load()) return;
+    {
+        std::lock_guard<std::mutex> lock(conn.inbox_mutex);
+        if (conn.inbox_eof) return;
+        if (conn.recv_paused.load() && conn.inbox_offset < conn.inbox.size()) return;
+    }
+    conn.recv_paused.store(false);
+    arm_recv(ring, conn);
+}
+
+// Starts a SENDMSG for up to MAX_IOV queued messages unless one is in flight.
+void submit_send(Ring &ring, Connection &conn) {
+    std::lock_guard<std::mutex> lock(conn.out_mutex);
+    if (conn.send_inflight || conn.out_queue.empty() || conn.out_closed || conn.closed.load()) return;
+    if (!conn.send_op) conn.send_op = std::make_unique<UringSend>();
+    UringSend &op = *conn.send_op;
+    size_t count = 0;
+    size_t offset = conn.out_offset;
+    for (const Message &message : conn.out_queue) {
+        if (count == MAX_IOV) break;
+        op.iov[count].iov_base = const_cast<char *>(message->data()) + offset;
+        op.iov[count].iov_len = message->size() - offset;
+        offset = 0;
+        ++count;
+    }
+    op.msg = msghdr{};
+    op.msg.msg_iov = op.iov;
+    op.msg.msg_iovlen = count;
+    conn.send_inflight = count;
+
+    io_uring_sqe *sqe = next_sqe(ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&op.msg);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_tag(OpSend, conn.fd);
+}
+
+// Last output to a disconnected client, such as "Authentication failed.":
+// whatever the socket takes right now, as on the epoll path. A send still in
+// flight is cancelled, since its client was not reading anyway.
+void flush_closed(Ring &ring, Connection &conn) {
+    std::lock_guard<std::mutex> lock(conn.out_mutex);
+    if (!conn.send_inflight) {
+        flush_locked(conn);
+        return;
+    }
+    io_uring_sqe *sqe = next_sqe(ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = uring_tag(OpSend, conn.fd);
+    sqe->user_data = uring_tag(OpCancel, conn.fd);
+}
+
+// Drops a disconnected client once the kernel holds no operation on it.
+void release_if_idle(Reactor &reactor, Connection &conn) {
+    if (!conn.closed.load() || conn.recv_armed) return;
+    {
+        std::lock_guard<std::mutex> lock(conn.out_mutex);
+        if (conn.send_inflight) return;
+    }
+    std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+    reactor.conns.erase(conn.fd);
+}
+
+void uring_accept(Reactor &reactor, Ring &ring, int client_socket) {
+    static const Message greeting = std::make_shared<const std::string>(GREETING);
+    set_nodelay(client_socket);
+    increment(Counter::Accepts);
+    auto conn = std::make_shared<Connection>(client_socket, &reactor);
     {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        // std::string left_message = clients[client_socket] + " has left the chat.";
-        clients.erase(client_socket);
-        // broadcast_message(client_socket, left_message);
+        std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+        reactor.conns[client_socket] = conn;
+    }
+    arm_recv(ring, *conn);
+    queue_message(*conn, greeting);
+}
+
+void uring_received(Ring &ring, Connection &conn, const io_uring_cqe &cqe) {
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) conn.recv_armed = false;
+    if (cqe.res > 0) {
+        uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(conn.inbox_mutex);
+            conn.inbox.append(ring.buffer(buffer_id), cqe.res);
+            full = conn.inbox.size() - conn.inbox_offset > INBOX_LIMIT;
+        }
+        ring.recycle_buffer(buffer_id);
+        // The workers are behind: stop receiving until they catch up.
+        if (full && !conn.recv_paused.exchange(true) && more) {
+            io_uring_sqe *sqe = next_sqe(ring);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = uring_tag(OpRecv, conn.fd);
+            sqe->user_data = uring_tag(OpCancel, conn.fd);
+        }
+    } else if (cqe.res == 0 || (cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+        std::lock_guard<std::mutex> lock(conn.inbox_mutex);
+        conn.inbox_eof = true;
     }
-    close(client_socket);
+    if (!more) resume_recv(ring, conn);
+    if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) schedule(conn.shared_from_this());
 }
 
-int main() {
-    int server_socket, client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+void uring_sent(Ring &ring, Connection &conn, int result) {
+    {
+        std::lock_guard<std::mutex> lock(conn.out_mutex);
+        conn.send_inflight = 0;
+        if (result < 0) {
+            conn.out_closed = true;
+            clear_queue_locked(conn);
+        } else {
+            consume_sent_locked(conn, result);
+        }
+    }
+    submit_send(ring, conn);
+}
 
-    load_users();
+// Same as flush_pending_connections, but output goes out as SQEs and paused
+// receives are resumed.
+void uring_flush_pending(Reactor &reactor, Ring &ring) {
+    uint64_t count;
+    ssize_t ignored = read(reactor.wake_fd, &count, sizeof(count));
+    (void)ignored;
+    reactor.wake_pending.store(false);
 
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    std::vector<std::shared_ptr<Connection>> pending;
+    {
+        std::lock_guard<std::mutex> lock(reactor.flush_mutex);
+        pending.swap(reactor.flush_list);
+    }
+    for (auto &conn : pending) {
+        conn->flush_pending.store(false);
+        if (conn->closed.load()) {
+            flush_closed(ring, *conn);
+            release_if_idle(reactor, *conn);
+            continue;
+        }
+        if (conn->recv_paused.load()) resume_recv(ring, *conn);
+        submit_send(ring, *conn);
+    }
+}
+
+// Completion loop of one reactor. Everything queued while handling a batch of
+// completions -- receives re-armed, a fan-out's sends -- goes to the kernel in
+// the next single io_uring_enter.
+void run_uring_reactor(Reactor &reactor) {
+    // The ring is single-issuer, so it must be created on this thread.
+    Ring ring;
+    if (!ring.init(URING_ENTRIES) || !ring.init_buffers(URING_BUFFER_GROUP, URING_BUFFERS, READ_CHUNK)) {
+        std::cerr << "Error creating io_uring instance." << std::endl;
+        return;
+    }
+    arm_accept(reactor, ring);
+    arm_wake(reactor, ring);
+    while (true) {
+        if (!ring.submit_and_wait(1)) {
+            std::cerr << "Error waiting for completions." << std::endl;
+            return;
+        }
+        ring.for_each_completion([&](const io_uring_cqe &cqe) {
+            UringOp op = static_cast<UringOp>(cqe.user_data >> 32);
+            int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+            bool more = cqe.flags & IORING_CQE_F_MORE;
+            if (op == OpAccept) {
+                if (cqe.res >= 0) uring_accept(reactor, ring, cqe.res);
+                if (!more) arm_accept(reactor, ring);
+                return;
+            }
+            if (op == OpWake) {
+                uring_flush_pending(reactor, ring);
+                if (!more) arm_wake(reactor, ring);
+                return;
+            }
+            if (op == OpCancel) return;
+            std::shared_ptr<Connection> conn;
+            {
+                std::lock_guard<std::mutex> lock(reactor.conns_mutex);
+                auto it = reactor.conns.find(fd);
+                if (it == reactor.conns.end()) return;
+                conn = it->second;
+            }
+            if (op == OpRecv) {
+                uring_received(ring, *conn, cqe);
+            } else if (op == OpSend) {
+                uring_sent(ring, *conn, cqe.res);
+            }
+            release_if_idle(reactor, *conn);
+        });
+        ring.publish_buffers();
+    }
+}
+
+// Whether this kernel supports everything run_uring_reactor needs.
+bool uring_available() {
+    Ring ring;
+    return ring.init(8) && ring.init_buffers(URING_BUFFER_GROUP, 8, READ_CHUNK);
+}
+
+int create_listen_socket(int listen_port, bool nonblocking, bool reuse_port) {
+    int server_socket = socket(AF_INET, SOCK_STREAM | (nonblocking ? SOCK_NONBLOCK : 0) | SOCK_CLOEXEC, 0);
     if (server_socket < 0) {
         std::cerr << "Error creating server socket." << std::endl;
-        return 1;
+        return -1;
+    }
+    int one = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (reuse_port) {
+        setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
     }
+
+    sockaddr_in server_addr{};
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(listen_port);
 
     if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         std::cerr << "Error binding server socket." << std::endl;
-        return 1;
+        close(server_socket);
+        return -1;
     }
-    if (listen(server_socket, 5) < 0) {
+    if (listen(server_socket, SOMAXCONN) < 0) {
         std::cerr << "Error listening on server socket." << std::endl;
-        return 1;
+        close(server_socket);
+        return -1;
     }
+    return server_socket;
+}
 
-    std::cout << "Server listening on port " << PORT << std::endl;
+// SO_REUSEPORT would let the reactors' listeners silently join a group that
+// another server on the same port already holds, splitting its clients
+// between the two. A plain bind fails on any listener already there.
+bool port_is_free(int listen_port) {
+    int probe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(probe, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(listen_port);
+    bool bound = bind(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(probe);
+    return bound;
+}
 
+// Serves stats_text() over plain HTTP for Prometheus scrapes. Each request
+// is answered with the full dump whatever its path; one scrape at a time.
+void serve_admin(int admin_socket) {
     while (true) {
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-        if (client_socket < 0) {
-            std::cerr << "Error accepting client connection." << std::endl;
+        int client = accept4(admin_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        ssize_t ignored = recv(client, request, sizeof(request), 0);
+        (void)ignored;
+
+        std::string body = stats_text();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\n\r\n" + body;
+        std::string_view data = response;
+        while (!data.empty()) {
+            ssize_t n = send(client, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            data.remove_prefix(n);
+        }
+        close(client);
+    }
+}
+
+// Parses --rate-limit=CLASS:RATE:BURST.
+bool parse_rate_limit(const std::string &spec) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) return false;
+    std::string name = spec.substr(0, colon);
+    RateLimit limit;
+    if (std::sscanf(spec.c_str() + colon + 1, "%u:%u", &limit.rate, &limit.burst) != 2) return false;
+    if ((limit.rate && !limit.burst) || limit.burst > MAX_RATE_BURST) return false;
+    if (name == "connection") rate_limits.connection = limit;
+    else if (name == "msg") rate_limits.commands[static_cast<int>(CommandClass::Private)] = limit;
+    else if (name == "broadcast") rate_limits.commands[static_cast<int>(CommandClass::Broadcast)] = limit;
+    else if (name == "group_msg") rate_limits.commands[static_cast<int>(CommandClass::Group)] = limit;
+    else if (name == "other") rate_limits.commands[static_cast<int>(CommandClass::Other)] = limit;
+    else if (name == "group") rate_limits.group = limit;
+    else if (name == "strikes") rate_limits.strikes = limit;
+    else return false;
+    return true;
+}
+
+// Tens of thousands of idle clients need as many descriptors, so lift the
+// soft limit to whatever the hard limit allows.
+void raise_fd_limit() {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string log_dir = "chatlog";
+    std::string users_file = "users.txt";
+    std::string hash_users_out;
+    uint32_t hash_iterations = DEFAULT_HASH_ITERATIONS;
+    size_t auth_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    std::string cluster_address;
+    std::vector<std::string> peers;
+    int admin_port = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--port=")) {
+            port = std::stoi(arg.substr(7));
+        } else if (arg.starts_with("--admin-port=")) {
+            admin_port = std::stoi(arg.substr(13));
+        } else if (arg.starts_with("--cluster=")) {
+            cluster_address = arg.substr(10);
+        } else if (arg.starts_with("--peers=")) {
+            std::stringstream list(arg.substr(8));
+            std::string peer;
+            while (std::getline(list, peer, ',')) {
+                if (!peer.empty()) peers.push_back(peer);
+            }
+        } else if (arg.starts_with("--log-dir=")) {
+            log_dir = arg.substr(10);
+        } else if (arg.starts_with("--users=")) {
+            users_file = arg.substr(8);
+        } else if (arg.starts_with("--hash-users=")) {
+            hash_users_out = arg.substr(13);
+        } else if (arg.starts_with("--hash-iterations=")) {
+            hash_iterations = std::max(1ul, std::stoul(arg.substr(18)));
+        } else if (arg.starts_with("--auth-threads=")) {
+            auth_threads = std::max(1ul, std::stoul(arg.substr(15)));
+        } else if (arg.starts_with("--rate-limit=")) {
+            if (!parse_rate_limit(arg.substr(13))) {
+                std::cerr << "Invalid " << arg << "; expected --rate-limit=CLASS:RATE:BURST with BURST at most "
+                          << MAX_RATE_BURST << "." << std::endl;
+                return 1;
+            }
+        } else if (arg.starts_with("--max-message=")) {
+            rate_limits.max_message = std::stoul(arg.substr(14));
+            if (rate_limits.max_message == 0 || rate_limits.max_message > MAX_MESSAGE_LIMIT) {
+                std::cerr << "Invalid " << arg << "; the limit is 1 to " << MAX_MESSAGE_LIMIT << " bytes." << std::endl;
+                return 1;
+            }
+            max_frame_size = std::max<size_t>(MAX_FRAME_SIZE, rate_limits.max_message + COMMAND_OVERHEAD);
+        } else if (arg == "--io=epoll") {
+            io_backend = IoBackend::Epoll;
+        } else if (arg == "--io=uring") {
+            io_backend = IoBackend::Uring;
+        } else if (arg == "--slow-consumer=drop") {
+            slow_consumer_policy = SlowConsumerPolicy::Drop;
+        } else if (arg == "--slow-consumer=disconnect") {
+            slow_consumer_policy = SlowConsumerPolicy::Disconnect;
+        } else if (arg == "--slow-consumer=coalesce") {
+            slow_consumer_policy = SlowConsumerPolicy::Coalesce;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--port=N] [--slow-consumer=drop|disconnect|coalesce] [--log-dir=DIR]\n"
+                      << "       [--io=epoll|uring] [--admin-port=N] [--cluster=HOST:PORT [--peers=HOST:PORT,...]]\n"
+                      << "       [--users=FILE] [--auth-threads=N] [--hash-users=OUT [--hash-iterations=N]]\n"
+                      << "       [--rate-limit=CLASS:RATE:BURST ...] [--max-message=BYTES]\n"
+                      << "       CLASS is connection, msg, broadcast, group_msg, other, group or strikes; RATE 0 disables it\n";
+            return 1;
+        }
+    }
+
+    if (!credentials.load(users_file)) {
+        std::cerr << "Error loading users from " << users_file << "." << std::endl;
+        return 1;
+    }
+    if (!hash_users_out.empty()) {
+        // Offline conversion of a plain-text users file; the server does not start.
+        auto table = credentials.snapshot();
+        if (table->hashed()) {
+            std::cerr << users_file << " is already hashed." << std::endl;
+            return 1;
+        }
+        if (!write_hashed_credentials(*table, hash_users_out, hash_iterations,
+                                      std::max(1u, std::thread::hardware_concurrency()))) {
+            std::cerr << "Error writing " << hash_users_out << "." << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << table->size() << " hashed users to " << hash_users_out << std::endl;
+        return 0;
+    }
+    if (!credentials.snapshot()->hashed()) {
+        std::cerr << "Warning: " << users_file << " stores plain-text passwords; convert it with --hash-users=OUT."
+                  << std::endl;
+    }
+    std::thread(watch_users_file, users_file).detach();
+
+    if (!cluster_address.empty()) {
+        Cluster::Handlers handlers;
+        handlers.on_private = [](std::string_view recipient, std::string_view sender, std::string_view payload) {
+            UserId recipient_id = user_names.find(recipient);
+            std::shared_ptr<Connection> client = recipient_id == NO_ID ? nullptr : online.find(recipient_id);
+            if (client) {
+                SharedFrame frame({.kind = Opcode::Private, .sender = user_names.intern(sender), .sender_name = sender,
+                                   .text = payload});
+                queue_delivery(*client, frame);
+            }
+            if (message_log) {
+                // Logged off while the message was in flight: keep it for later.
+                message_log->append(RecordKind::Private, recipient, sender, payload, client ? 0 : RECORD_FLAG_OFFLINE);
+            }
+        };
+        handlers.on_group_text = [](std::string_view group_name, std::string_view text) {
+            // Already formatted by the sending node, so binary clients get it as Text.
+            if (Group<Connection> *group = groups.find(group_name)) {
+                SharedFrame frame({.text = text});
+                deliver_group(*group, nullptr, frame);
+            }
+        };
+        handlers.on_broadcast = [](std::string_view text) {
+            SharedFrame frame({.text = text});
+            deliver_broadcast(nullptr, frame);
+        };
+        handlers.on_group_created = [](std::string_view group_name) { groups.create(group_name); };
+        cluster = new Cluster();
+        if (!cluster->start(cluster_address, peers, std::move(handlers))) {
+            std::cerr << "Error starting cluster on " << cluster_address << "." << std::endl;
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+
+    if (!log_dir.empty()) {
+        message_log = new MessageLog();
+        if (!message_log->open(log_dir)) {
+            std::cerr << "Error opening message log in " << log_dir << "." << std::endl;
+            return 1;
+        }
+    }
+
+    if (io_backend == IoBackend::Uring && !uring_available()) {
+        std::cerr << "Warning: io_uring is unavailable; using epoll." << std::endl;
+        io_backend = IoBackend::Epoll;
+    }
+
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    workers = new WorkerPool(num_threads);
+    auth_pool = new WorkerPool(auth_threads, AUTH_QUEUE_LIMIT);
+
+    // One reactor per core, each with its own listening socket.
+    if (!port_is_free(port)) {
+        std::cerr << "Error: port " << port << " is already in use." << std::endl;
+        return 1;
+    }
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    for (size_t i = 0; i < num_threads; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        // io_uring waits for connections itself, so its listener blocks.
+        reactor->listen_fd = create_listen_socket(port, io_backend == IoBackend::Epoll, true);
+        if (reactor->listen_fd < 0) {
+            return 1;
+        }
+        reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (io_backend == IoBackend::Uring) {
+            reactors.push_back(std::move(reactor));
             continue;
         }
-        std::thread(handle_client, client_socket).detach();
+        reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactor->epoll_fd < 0) {
+            std::cerr << "Error creating epoll instance." << std::endl;
+            return 1;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = reactor->listen_fd;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &ev);
+
+        ev.events = EPOLLIN;
+        ev.data.fd = reactor->wake_fd;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev);
+        reactors.push_back(std::move(reactor));
     }
 
-    close(server_socket);
+    if (admin_port) {
+        int admin_socket = create_listen_socket(admin_port, false, false);
+        if (admin_socket < 0) {
+            return 1;
+        }
+        std::thread(serve_admin, admin_socket).detach();
+    }
+
+    std::cout << "Server listening on port " << port << std::endl;
+
+    std::vector<std::thread> reactor_threads;
+    for (auto &reactor : reactors) {
+        reactor_threads.emplace_back(io_backend == IoBackend::Uring ? run_uring_reactor : run_reactor,
+                                     std::ref(*reactor));
+    }
+    for (auto &thread : reactor_threads) {
+        thread.join();
+    }
     return 0;
 }
@@ -0,0 +1,198 @@
+// Minimal io_uring wrapper on the raw system calls (no liburing).
+//
+// A Ring is owned by one thread: it is created, submitted to and reaped on
+// that thread only, which lets it use IORING_SETUP_SINGLE_ISSUER and
+// DEFER_TASKRUN where the kernel has them. SQEs are handed out with get_sqe()
+// and all of them go to the kernel in the next submit_and_wait(), so every
+// operation queued while handling one batch of completions costs a single
+// io_uring_enter.
+//
+// A Ring can also own a provided buffer ring: a pool of fixed-size receive
+// buffers registered with the kernel, from which multishot receives pick a
+// buffer per completion. The caller copies the data out and recycles the
+// buffer; recycled buffers are published to the kernel in one store.
+
+#ifndef CHAT_URING_H
+#define CHAT_URING_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class Ring {
+public:
+    Ring() = default;
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+    ~Ring() {
+        if (buffer_ring) munmap(buffer_ring, buffer_ring_size);
+        if (buffers) munmap(buffers, buffer_count * buffer_size);
+        if (sqes) munmap(sqes, sq_entries * sizeof(io_uring_sqe));
+        if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+        if (sq_ptr) munmap(sq_ptr, sq_size);
+        if (fd >= 0) close(fd);
+    }
+
+    // Creates a ring with `entries` SQEs and four times as many CQEs. Returns
+    // false if io_uring is unavailable.
+    bool init(unsigned entries) {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER |
+                       IORING_SETUP_DEFER_TASKRUN;
+        params.cq_entries = entries * 4;
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0 && errno == EINVAL) {
+            // Older kernel: keep only the flags every io_uring kernel knows.
+            params = io_uring_params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = entries * 4;
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        }
+        if (fd < 0) return false;
+        defer_taskrun = params.flags & IORING_SETUP_DEFER_TASKRUN;
+
+        sq_entries = params.sq_entries;
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap && cq_size > sq_size) sq_size = cq_size;
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            sq_ptr = nullptr;
+            return false;
+        }
+        cq_ptr = single_mmap ? sq_ptr
+                             : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                    IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            cq_ptr = nullptr;
+            return false;
+        }
+        void *sqe_map = mmap(nullptr, sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe *>(sqe_map);
+
+        char *sq = static_cast<char *>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        unsigned *sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; ++i) sq_array[i] = i;
+        local_tail = *sq_tail;
+
+        char *cq = static_cast<char *>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Registers `count` buffers of `size` bytes as provided-buffer group
+    // `group`. count must be a power of two.
+    bool init_buffers(uint16_t group, unsigned count, unsigned size) {
+        buffer_group = group;
+        buffer_count = count;
+        buffer_size = size;
+        buffer_mask = count - 1;
+        buffer_ring_size = count * sizeof(io_uring_buf);
+        void *ring_map = mmap(nullptr, buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void *buffer_map = mmap(nullptr, size_t(count) * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring_map == MAP_FAILED || buffer_map == MAP_FAILED) return false;
+        buffer_ring = static_cast<io_uring_buf_ring *>(ring_map);
+        buffers = static_cast<char *>(buffer_map);
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+        for (unsigned i = 0; i < count; ++i) recycle_buffer(static_cast<uint16_t>(i));
+        publish_buffers();
+        return true;
+    }
+
+    // Returns a zeroed SQE, or nullptr if the submission queue is full (call
+    // submit_and_wait(0) and retry).
+    io_uring_sqe *get_sqe() {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (local_tail - head >= sq_entries) return nullptr;
+        io_uring_sqe *sqe = &sqes[local_tail & sq_mask];
+        ++local_tail;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Submits every SQE handed out since the last call and waits for at least
+    // wait_nr completions. Returns false on an unexpected error.
+    bool submit_and_wait(unsigned wait_nr) {
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = local_tail - submitted;
+        unsigned flags = (wait_nr || defer_taskrun) ? IORING_ENTER_GETEVENTS : 0;
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, nullptr, 0);
+            if (ret >= 0) {
+                submitted += ret;
+                return true;
+            }
+            if (errno == EINTR) continue;
+            // Completions must be reaped before more can be submitted.
+            return errno == EBUSY || errno == EAGAIN;
+        }
+    }
+
+    // Calls fn on every available completion, then releases them.
+    template <typename Fn>
+    void for_each_completion(Fn fn) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) fn(cqes[head & cq_mask]);
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    char *buffer(uint16_t id) const { return buffers + size_t(id) * buffer_size; }
+
+    // Hands a buffer back to the kernel; visible after publish_buffers().
+    void recycle_buffer(uint16_t id) {
+        // Not buffer_ring->bufs: in C++ the header's flex-array wrapper moves
+        // it off offset 0, where the kernel expects the first entry.
+        io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(buffer_ring)[buffer_tail & buffer_mask];
+        buf.addr = reinterpret_cast<uint64_t>(buffer(id));
+        buf.len = buffer_size;
+        buf.bid = id;
+        ++buffer_tail;
+    }
+    void publish_buffers() { __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE); }
+
+    uint16_t group() const { return buffer_group; }
+
+private:
+    int fd = -1;
+    bool defer_taskrun = false;
+    unsigned sq_entries = 0;
+    size_t sq_size = 0, cq_size = 0;
+    void *sq_ptr = nullptr;
+    void *cq_ptr = nullptr;
+    io_uring_sqe *sqes = nullptr;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned local_tail = 0;  // SQEs handed out
+    unsigned submitted = 0;   // SQEs consumed by the kernel
+    unsigned *cq_head = nullptr, *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    io_uring_buf_ring *buffer_ring = nullptr;
+    size_t buffer_ring_size = 0;
+    char *buffers = nullptr;
+    unsigned buffer_count = 0, buffer_size = 0, buffer_mask = 0;
+    uint16_t buffer_tail = 0;
+    uint16_t buffer_group = 0;
+};
+
+#endif // CHAT_URING_H
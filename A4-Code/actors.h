@@ -0,0 +1,476 @@
+// Message-passing DVR: every router is an actor that owns its row of the
+// routing table and an inbox, and learns routes only from the messages its
+// neighbours send it.
+//
+// A message is one batch from one router to one neighbour. It carries
+// advertisements (dest, cost), the sender's current routes, and requests
+// (dest), which ask the receiver to advertise its route to dest back. A
+// router applies the distance-vector rules of RIP to a batch:
+//  - an advertisement from the current next hop is always taken, even if it
+//    is worse;
+//  - from anyone else, only a cheaper route is taken;
+//  - costs of LinkTable::dvInfinity() or more are unreachable, so a loop
+//    counts up to it and stops, as RIP does at 16. That is INF (9999), or
+//    more when the links allow a loop-free route that dear.
+// Every changed route is then advertised to the nodes that link to the
+// router, poisoned (unreachable) towards the neighbour it goes through unless
+// poisoned reverse is off. A route that got worse is also requested from
+// all of the router's next hops, so a better route elsewhere is found again.
+//
+// Inboxes are lock-free multi-producer single-consumer queues, so any number
+// of routers on any threads send to a router while it drains its inbox. A
+// message from u to v takes delay(u, v) time units, fixed per link and drawn
+// from [minDelay, maxDelay]. There are two modes:
+//  - sync: a global clock. At each time step every router with messages due
+//    processes them, in sender order. The routers run across the thread
+//    pool, and the result does not depend on the thread count.
+//  - async: no clock and no rounds. A router is scheduled on a worker's run
+//    queue as soon as mail arrives, runs whenever a thread takes it, and
+//    handles everything in its inbox at once. Idle workers steal routers
+//    from the others' queues. Delays then only advance per-router logical
+//    clocks (Lamport time), so "time" is the latest logical time of any
+//    delivery.
+// Convergence is reached when no message is left anywhere.
+//
+// Like incremental.h, this keeps full n x n tables, so it is limited to
+// topologies that fit in one DVR block.
+
+#ifndef ROUTING_ACTORS_H
+#define ROUTING_ACTORS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "graph.h"
+#include "incremental.h"
+#include "thread_pool.h"
+
+struct MpscNode {
+    std::atomic<MpscNode*> next{nullptr};
+};
+
+// Intrusive lock-free queue (Vyukov): any thread may push, one thread pops.
+// A push is one exchange and one store.
+class MpscQueue {
+public:
+    MpscQueue() : head(&stub), tail(&stub) {}
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(MpscNode* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = head.exchange(node);
+        prev->next.store(node);
+    }
+
+    // The oldest node, or nullptr if the queue is empty. A push that has
+    // started but not yet linked its node is waited for, never skipped.
+    MpscNode* pop() {
+        MpscNode* t = tail;
+        MpscNode* next = t->next.load();
+        if (t == &stub) {
+            if (!next) {
+                if (head.load() == &stub) return nullptr;
+                next = waitNext(t);
+            }
+            tail = t = next;
+            next = t->next.load();
+        }
+        if (!next) {
+            // t is the last node: put the stub behind it so it can be handed out
+            if (t == head.load()) push(&stub);
+            next = waitNext(t);
+        }
+        tail = next;
+        return t;
+    }
+
+private:
+    static MpscNode* waitNext(MpscNode* node) {
+        MpscNode* next;
+        while (!(next = node->next.load())) std::this_thread::yield();
+        return next;
+    }
+
+    std::atomic<MpscNode*> head;  // last pushed
+    MpscNode* tail;               // next to pop
+    MpscNode stub;
+};
+
+struct ActorOptions {
+    bool async = false;
+    bool poisonReverse = true;
+    int minDelay = 1;
+    int maxDelay = 1;
+    uint64_t seed = 1;
+};
+
+class DvrActors {
+public:
+    struct Convergence {
+        int64_t time = 0;          // time units from the first send to the last delivery
+        int64_t messages = 0;
+        int64_t entries = 0;       // advertisements and requests carried
+        int64_t routeChanges = 0;
+    };
+
+    DvrActors(const LinkTable& links, ThreadPool& pool, const ActorOptions& options)
+        : links(links), pool(pool), options(options), n(links.size()), infinity(links.dvInfinity()),
+          routers(new Router[n]),
+          dist(size_t(n) * n, UNREACHABLE), hop(size_t(n) * n, -1), queues(new RunQueue[pool.size()]),
+          scratch(pool.size()) {
+        for (Scratch& s : scratch) {
+            s.isChanged.assign(n, 0);
+            s.isWorse.assign(n, 0);
+        }
+    }
+    ~DvrActors() {
+        for (int a = 0; a < n; ++a) {
+            while (MpscNode* m = routers[a].inbox.pop()) delete static_cast<Message*>(m);
+            for (Message* m : routers[a].held) delete m;
+        }
+    }
+
+    // Cold start: every router knows only itself and announces that.
+    Convergence start() {
+        for (int a = 0; a < n; ++a) {
+            dist[entry(a, a)] = 0;
+            markChanged(scratch[0], a);
+            emit(a, now, 0);
+        }
+        return converge();
+    }
+
+    // The link u -> v changed from oldCost (UNREACHABLE if it did not exist)
+    // to its cost in the LinkTable. u fixes the routes through v at once, and
+    // the messages that follow are delivered by the next converge().
+    void linkChanged(int u, int v, int oldCost) {
+        Scratch& s = scratch[0];
+        infinity = links.dvInfinity();
+        int cost = links.cost(u, v);
+        if (oldCost != UNREACHABLE && cost != oldCost) {
+            for (int k = 0; k < n; ++k) {
+                size_t e = entry(u, k);
+                if (hop[e] != v) continue;
+                int updated = cost == UNREACHABLE ? UNREACHABLE : clamp(int64_t(dist[e]) - oldCost + cost);
+                setRoute(s, u, k, updated, updated == UNREACHABLE ? -1 : v);
+            }
+        }
+        // A new or cheaper link may be the better way to anything v reaches
+        if (cost < oldCost) s.requestAll.push_back(v);
+        emit(u, now, 0);
+    }
+
+    // Delivers messages until none is left anywhere.
+    Convergence converge() {
+        int64_t begin = now;
+        if (options.async) runAsync();
+        else runSync();
+        Convergence result;
+        for (Scratch& s : scratch) {
+            result.messages += s.messages;
+            result.entries += s.entries;
+            result.routeChanges += s.routeChanges;
+            s.messages = s.entries = s.routeChanges = 0;
+            now = std::max(now, s.lastTime);
+        }
+        result.time = now - begin;
+        return result;
+    }
+
+    // The same accessors as DvrEngine, for TableWriter.
+    int firstDest() const { return 0; }
+    int blockWidth() const { return n; }
+    int cost(int node, int d) const { return dist[entry(node, d)]; }
+    int nextHop(int node, int d) const { return hop[entry(node, d)]; }
+
+private:
+    struct Message : MpscNode {
+        int from;
+        int64_t time;                          // delivery time
+        uint64_t seq;                          // sender's count, to keep its messages in order
+        std::vector<std::pair<int, int>> ads;  // (dest, cost)
+        std::vector<int> requests;
+    };
+
+    struct alignas(64) Router {
+        MpscQueue inbox;
+        std::atomic<bool> scheduled{false};  // async: on a run queue or running
+        std::atomic<int> mail{0};            // async: messages sent and not yet taken
+        std::vector<Message*> held;          // sync: delivered later, a min-heap by time
+        int64_t clock = 0;                   // async: logical time
+        uint64_t sent = 0;
+    };
+
+    struct alignas(64) RunQueue {
+        std::mutex lock;
+        std::deque<int> routers;
+    };
+
+    // Per-worker state for one router run.
+    struct alignas(64) Scratch {
+        std::vector<Message*> batch;
+        std::vector<int> changed, worse;
+        std::vector<char> isChanged, isWorse;
+        std::vector<std::pair<int, int>> replies;  // (neighbour, dest) asked for
+        std::vector<int> requestAll;               // neighbours to ask for everything
+        int64_t messages = 0, entries = 0, routeChanges = 0;
+        int64_t lastTime = 0;
+        int64_t nextDue = std::numeric_limits<int64_t>::max();  // sync: earliest message sent
+    };
+
+    size_t entry(int i, int k) const { return size_t(i) * n + k; }
+    int clamp(int64_t cost) const { return cost >= infinity ? UNREACHABLE : int(cost); }
+
+    // Time a message takes between u and v, the same both ways.
+    int delay(int u, int v) const {
+        if (options.maxDelay <= options.minDelay) return options.minDelay;
+        uint64_t x = options.seed ^ (uint64_t(std::min(u, v)) << 32 | uint64_t(std::max(u, v)));
+        // splitmix64 finalizer
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return options.minDelay + int(x % uint64_t(options.maxDelay - options.minDelay + 1));
+    }
+
+    void markChanged(Scratch& s, int k) {
+        if (!s.isChanged[k]) {
+            s.isChanged[k] = 1;
+            s.changed.push_back(k);
+        }
+    }
+
+    void setRoute(Scratch& s, int a, int k, int cost, int next) {
+        size_t e = entry(a, k);
+        if (cost == dist[e] && next == hop[e]) return;
+        if (cost > dist[e] && !s.isWorse[k]) {
+            s.isWorse[k] = 1;
+            s.worse.push_back(k);
+        }
+        dist[e] = cost;
+        hop[e] = next;
+        ++s.routeChanges;
+        markChanged(s, k);
+    }
+
+    // 1) Applies a batch of messages to router a's routes.
+    void process(int a, const std::vector<Message*>& batch, Scratch& s) {
+        for (const Message* m : batch) {
+            int j = m->from;
+            int link = links.cost(a, j);
+            for (const std::pair<int, int>& ad : m->ads) {
+                int k = ad.first;
+                if (k == a || link == UNREACHABLE) continue;
+                int offered = ad.second == UNREACHABLE ? UNREACHABLE : clamp(int64_t(ad.second) + link);
+                size_t e = entry(a, k);
+                if (hop[e] == j) setRoute(s, a, k, offered, offered == UNREACHABLE ? -1 : j);
+                else if (offered < dist[e]) setRoute(s, a, k, offered, j);
+            }
+            for (int k : m->requests) s.replies.push_back({j, k});
+        }
+    }
+
+    // 2) Sends what the run produced: changed routes and replies to the nodes
+    //    linking to a, requests to the nodes a links to. One message per
+    //    neighbour.
+    void emit(int a, int64_t time, int w) {
+        Scratch& s = scratch[w];
+        std::sort(s.changed.begin(), s.changed.end());
+        std::sort(s.replies.begin(), s.replies.end());
+        const std::vector<LinkTable::Link>& listeners = links.linksTo(a);
+        const std::vector<LinkTable::Link>& nextHops = links.linksFrom(a);
+        size_t li = 0, hi = 0, ri = 0;
+        while (li < listeners.size() || hi < nextHops.size()) {
+            int x = std::min(li < listeners.size() ? listeners[li].node : n, hi < nextHops.size() ? nextHops[hi].node : n);
+            Message* m = nullptr;
+            auto message = [&]() -> Message* {
+                if (!m) {
+                    m = new Message;
+                    m->from = a;
+                    m->time = time + delay(a, x);
+                    m->seq = routers[a].sent++;
+                }
+                return m;
+            };
+            if (li < listeners.size() && listeners[li].node == x) {
+                ++li;
+                // Changed routes, merged with the ones x asked for
+                while (ri < s.replies.size() && s.replies[ri].first < x) ++ri;
+                size_t r = ri;
+                while (r < s.replies.size() && s.replies[r].first == x) ++r;
+                size_t c = 0;
+                while (c < s.changed.size() || ri < r) {
+                    int k;
+                    if (ri == r || (c < s.changed.size() && s.changed[c] <= s.replies[ri].second)) k = s.changed[c++];
+                    else k = s.replies[ri++].second;
+                    std::vector<std::pair<int, int>>& ads = message()->ads;
+                    if (ads.empty() || ads.back().first != k) ads.push_back({k, advertised(a, k, x)});
+                }
+            }
+            if (hi < nextHops.size() && nextHops[hi].node == x) {
+                ++hi;
+                if (std::find(s.requestAll.begin(), s.requestAll.end(), x) != s.requestAll.end()) {
+                    std::vector<int>& requests = message()->requests;
+                    for (int k = 0; k < n; ++k) {
+                        if (k != a) requests.push_back(k);
+                    }
+                } else if (!s.worse.empty()) {
+                    message()->requests = s.worse;
+                }
+            }
+            if (m) send(x, m, w);
+        }
+        for (int k : s.changed) s.isChanged[k] = 0;
+        for (int k : s.worse) s.isWorse[k] = 0;
+        s.changed.clear();
+        s.worse.clear();
+        s.replies.clear();
+        s.requestAll.clear();
+    }
+
+    // Cost of a's route to k as told to neighbour x: poisoned if it goes
+    // through x.
+    int advertised(int a, int k, int x) const {
+        size_t e = entry(a, k);
+        return options.poisonReverse && hop[e] == x ? UNREACHABLE : dist[e];
+    }
+
+    void send(int x, Message* m, int w) {
+        Scratch& s = scratch[w];
+        ++s.messages;
+        s.entries += m->ads.size() + m->requests.size();
+        s.nextDue = std::min(s.nextDue, m->time);
+        if (options.async) {
+            pending.fetch_add(1);
+            routers[x].mail.fetch_add(1);
+        }
+        routers[x].inbox.push(m);
+        if (options.async && !routers[x].scheduled.exchange(true)) schedule(x, w);
+    }
+
+    // Sync mode: one time step at a time, every router in parallel.
+    void runSync() {
+        const int64_t none = std::numeric_limits<int64_t>::max();
+        auto earliest = [&] {
+            int64_t due = none;
+            for (Scratch& s : scratch) {
+                due = std::min(due, s.nextDue);
+                s.nextDue = none;
+            }
+            return due;
+        };
+        for (int64_t t = earliest(); t != none; t = earliest()) {
+            pool.parallelFor(n, [&](int a, int w) { stepRouter(a, t, w); });
+        }
+    }
+
+    void stepRouter(int a, int64_t t, int w) {
+        Scratch& s = scratch[w];
+        Router& r = routers[a];
+        auto later = [](const Message* x, const Message* y) { return x->time > y->time; };
+        while (MpscNode* node = r.inbox.pop()) {
+            r.held.push_back(static_cast<Message*>(node));
+            std::push_heap(r.held.begin(), r.held.end(), later);
+        }
+        s.batch.clear();
+        while (!r.held.empty() && r.held.front()->time <= t) {
+            std::pop_heap(r.held.begin(), r.held.end(), later);
+            s.batch.push_back(r.held.back());
+            r.held.pop_back();
+        }
+        if (!r.held.empty()) s.nextDue = std::min(s.nextDue, r.held.front()->time);
+        if (s.batch.empty()) return;
+        // Sender order, so the outcome does not depend on thread timing
+        std::sort(s.batch.begin(), s.batch.end(), [](const Message* x, const Message* y) {
+            return x->from < y->from || (x->from == y->from && x->seq < y->seq);
+        });
+        process(a, s.batch, s);
+        emit(a, t, w);
+        s.lastTime = std::max(s.lastTime, t);
+        for (Message* m : s.batch) delete m;
+    }
+
+    // Async mode: every worker runs routers from its queue, or steals, until
+    // no message is in flight.
+    void runAsync() {
+        for (int a = 0; a < n; ++a) routers[a].clock = std::max(routers[a].clock, now);
+        pool.parallelFor(pool.size(), [&](int, int w) {
+            for (;;) {
+                int a = take(w);
+                if (a >= 0) runRouter(a, w);
+                else if (pending.load() == 0) break;
+                else std::this_thread::yield();
+            }
+        });
+        // Routers scheduled for mail that an earlier run already handled
+        for (int w = 0; w < pool.size(); ++w) queues[w].routers.clear();
+        for (int a = 0; a < n; ++a) routers[a].scheduled.store(false);
+    }
+
+    // A router is on at most one run queue and runs on one thread at a time:
+    // scheduled stays set until the run is over, and mail that arrived
+    // meanwhile puts it back on the queue.
+    void runRouter(int a, int w) {
+        Scratch& s = scratch[w];
+        Router& r = routers[a];
+        s.batch.clear();
+        while (MpscNode* node = r.inbox.pop()) s.batch.push_back(static_cast<Message*>(node));
+        r.mail.fetch_sub(s.batch.size());
+        if (!s.batch.empty()) {
+            std::sort(s.batch.begin(), s.batch.end(), [](const Message* x, const Message* y) {
+                if (x->time != y->time) return x->time < y->time;
+                return x->from < y->from || (x->from == y->from && x->seq < y->seq);
+            });
+            r.clock = std::max(r.clock, s.batch.back()->time);
+            process(a, s.batch, s);
+            emit(a, r.clock, w);
+            s.lastTime = std::max(s.lastTime, r.clock);
+            for (Message* m : s.batch) delete m;
+        }
+        r.scheduled.store(false);
+        if (r.mail.load() > 0 && !r.scheduled.exchange(true)) schedule(a, w);
+        pending.fetch_sub(s.batch.size());
+    }
+
+    void schedule(int a, int w) {
+        std::lock_guard<std::mutex> lock(queues[w].lock);
+        queues[w].routers.push_back(a);
+    }
+
+    // The oldest router on w's own queue, else on another's. First in, first
+    // out keeps the exchange breadth-first: taking the newest router first
+    // lets some routes be rebuilt many times over before the others move.
+    int take(int w) {
+        for (int k = 0; k < pool.size(); ++k) {
+            RunQueue& q = queues[(w + k) % pool.size()];
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (q.routers.empty()) continue;
+            int a = q.routers.front();
+            q.routers.pop_front();
+            return a;
+        }
+        return -1;
+    }
+
+    const LinkTable& links;
+    ThreadPool& pool;
+    ActorOptions options;
+    int n;
+    int infinity;  // links.dvInfinity() as of the last change; fixed while routers run
+    std::unique_ptr<Router[]> routers;
+    std::vector<int> dist;  // row a belongs to router a
+    std::vector<int> hop;
+    std::unique_ptr<RunQueue[]> queues;
+    std::vector<Scratch> scratch;
+    std::atomic<int64_t> pending{0};  // async: messages sent and not yet handled
+    int64_t now = 0;
+};
+
+#endif // ROUTING_ACTORS_H
@@ -0,0 +1,146 @@
+// Distance vector routing engine.
+//
+// Each round every node whose vector changed in the previous round sends it to
+// the nodes that link to it, and each receiver keeps, per destination, the
+// cheapest of its current route and "link cost + neighbour's distance". This
+// is the synchronous Bellman-Ford exchange of real DVR: only links are
+// relaxed, and a node whose vector did not change sends nothing, so a round
+// costs the links of the dirty nodes rather than n^3.
+//
+// Destinations are independent of each other in this exchange, so an engine
+// covers one block of destinations [first, first + width). The tables are two
+// n x width buffers: a round reads the front buffer and writes the back one,
+// then they swap. The back buffer only lags the front by the rows that changed
+// in the previous round, so those rows are all that is copied before writing.
+// Large topologies, whose full n x n tables would not fit in memory, are run
+// as a series of blocks (see dvrBlockWidth).
+
+#ifndef ROUTING_DVR_H
+#define ROUTING_DVR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "graph.h"
+#include "minplus.h"
+
+#define DVR_BLOCK_BYTES (256 << 20)  // table memory for one block of destinations
+
+// Widest block whose two buffers of costs and next hops fit DVR_BLOCK_BYTES.
+inline int dvrBlockWidth(int n) {
+    int64_t perDest = int64_t(n) * 4 * sizeof(int);
+    int64_t width = DVR_BLOCK_BYTES / std::max<int64_t>(perDest, 1);
+    return int(std::min<int64_t>(n, std::max<int64_t>(width, 8)));
+}
+
+class DvrEngine {
+public:
+    DvrEngine(const Graph& graph, int first, int width)
+        : in(graph.transpose()), n(graph.n), first(first), width(width),
+          isDirty(graph.n, 0) {
+        for (int b = 0; b < 2; ++b) {
+            dist[b].assign(size_t(n) * width, UNREACHABLE);
+            hop[b].assign(size_t(n) * width, -1);
+        }
+        // 1) Initialization: every node knows itself and its direct links
+        for (int u = 0; u < n; ++u) {
+            int* d = dist[0].data() + size_t(u) * width;
+            int* h = hop[0].data() + size_t(u) * width;
+            if (u >= first && u < first + width) d[u - first] = 0;
+            for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+                int v = graph.targets[e] - first;
+                if (v < 0 || v >= width || graph.costs[e] >= d[v]) continue;
+                d[v] = graph.costs[e];
+                h[v] = graph.targets[e];
+            }
+            dirty.push_back(u);
+        }
+        dist[1] = dist[0];
+        hop[1] = hop[0];
+    }
+
+    // Runs one exchange round. Returns false once no vector changed.
+    bool step() {
+        int back = front ^ 1;
+        ++round;
+        // 2) Bring the back buffer up to date with the rows the last round wrote
+        for (int u : stale) {
+            size_t row = size_t(u) * width;
+            std::memcpy(dist[back].data() + row, dist[front].data() + row, width * sizeof(int));
+            std::memcpy(hop[back].data() + row, hop[front].data() + row, width * sizeof(int));
+        }
+        stale.clear();
+
+        // 3) Every node whose vector changed advertises it to the nodes linking to it
+        for (int j : dirty) {
+            const int* via = dist[front].data() + size_t(j) * width;
+            for (int e = in.offsets[j]; e < in.offsets[j + 1]; ++e) {
+                int i = in.targets[e];
+                if (relax(dist[back].data() + size_t(i) * width, hop[back].data() + size_t(i) * width,
+                          via, in.costs[e], j) &&
+                    !isDirty[i]) {
+                    isDirty[i] = 1;
+                    stale.push_back(i);
+                }
+            }
+            relaxations += in.degree(j);
+        }
+
+        // 4) The rows changed this round are next round's senders
+        for (int u : stale) isDirty[u] = 0;
+        std::sort(stale.begin(), stale.end());  // node order, for locality and deltas
+        dirty = stale;
+        front = back;
+        return !dirty.empty();
+    }
+
+    // Rounds run so far.
+    int rounds() const { return round; }
+    // Link relaxations so far, each covering the whole block.
+    int64_t linkRelaxations() const { return relaxations; }
+    // Nodes whose vector changed in the last round.
+    int changedNodes() const { return dirty.size(); }
+
+    // Calls fn(node, d) for every entry the last round changed. The back
+    // buffer still holds the previous round's values of the changed rows.
+    template <class Fn>
+    void forEachChange(Fn fn) const {
+        const int* now = dist[front].data();
+        const int* before = dist[front ^ 1].data();
+        for (int u : dirty) {
+            size_t row = size_t(u) * width;
+            for (int d = 0; d < width; ++d) {
+                if (now[row + d] != before[row + d]) fn(u, d);
+            }
+        }
+    }
+
+    int firstDest() const { return first; }
+    int blockWidth() const { return width; }
+    // Cost and next hop from node to destination first + d.
+    int cost(int node, int d) const { return dist[front][size_t(node) * width + d]; }
+    int nextHop(int node, int d) const { return hop[front][size_t(node) * width + d]; }
+
+private:
+    // Takes every destination in the row that is cheaper through neighbour j,
+    // with the vector kernel picked for this CPU (minplus.h).
+    bool relax(int* d, int* h, const int* via, int linkCost, int j) const {
+        return minplus::row(d, h, via, linkCost, j, width);
+    }
+
+    Graph in;  // links reversed: the nodes that hear each node's vector
+    int n;
+    int first;
+    int width;
+    std::vector<int> dist[2];
+    std::vector<int> hop[2];
+    int front = 0;
+    int round = 0;
+    int64_t relaxations = 0;
+    std::vector<int> dirty;       // nodes to advertise this round
+    std::vector<int> stale;       // rows where the back buffer lags the front
+    std::vector<char> isDirty;
+};
+
+#endif // ROUTING_DVR_H
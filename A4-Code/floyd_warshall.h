@@ -0,0 +1,73 @@
+// Blocked Floyd-Warshall: all-pairs shortest paths computed independently of
+// the DVR and LSR engines, to cross-check their tables (routing_sim --check).
+//
+// The n x n tables are cut into FW_TILE x FW_TILE tiles. For each diagonal
+// tile kk in turn: the tile kk itself is closed over its own k range, then
+// the tiles in its row and column, then all the rest, each from tiles already
+// final for that k range. A tile update runs row by row through the same
+// min-plus kernel as DVR (minplus.h). Its rows of costs and next hops, and
+// the k rows it reads, stay in cache for the whole tile. The result is the
+// same as the textbook triple loop.
+
+#ifndef ROUTING_FLOYD_WARSHALL_H
+#define ROUTING_FLOYD_WARSHALL_H
+
+#include <algorithm>
+#include <vector>
+#include "graph.h"
+#include "minplus.h"
+
+#define FW_TILE 64
+
+class FloydWarshall {
+public:
+    explicit FloydWarshall(const Graph& g) : n(g.n), dist(size_t(n) * n, UNREACHABLE), hop(size_t(n) * n, -1) {
+        // 1) Direct links, and every node reaches itself for free
+        for (int u = 0; u < n; ++u) {
+            dist[size_t(u) * n + u] = 0;
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                dist[size_t(u) * n + g.targets[e]] = g.costs[e];
+                hop[size_t(u) * n + g.targets[e]] = g.targets[e];
+            }
+        }
+        // 2) Close over one band of intermediate nodes at a time
+        for (int kk = 0; kk < n; kk += FW_TILE) {
+            tile(kk, kk, kk);
+            for (int t = 0; t < n; t += FW_TILE) {
+                if (t == kk) continue;
+                tile(kk, t, kk);
+                tile(t, kk, kk);
+            }
+            for (int i = 0; i < n; i += FW_TILE) {
+                if (i == kk) continue;
+                for (int j = 0; j < n; j += FW_TILE) {
+                    if (j != kk) tile(i, j, kk);
+                }
+            }
+        }
+    }
+
+    int cost(int src, int dst) const { return dist[size_t(src) * n + dst]; }
+    int nextHop(int src, int dst) const { return hop[size_t(src) * n + dst]; }
+
+private:
+    // Relaxes tile (rows i0.., columns j0..) through intermediates k0...
+    void tile(int i0, int j0, int k0) {
+        int iEnd = std::min(i0 + FW_TILE, n), jEnd = std::min(j0 + FW_TILE, n), kEnd = std::min(k0 + FW_TILE, n);
+        for (int k = k0; k < kEnd; ++k) {
+            const int* via = &dist[size_t(k) * n + j0];
+            for (int i = i0; i < iEnd; ++i) {
+                int toK = dist[size_t(i) * n + k];
+                if (toK == UNREACHABLE || i == k) continue;
+                minplus::row(&dist[size_t(i) * n + j0], &hop[size_t(i) * n + j0], via, toK,
+                             hop[size_t(i) * n + k], jEnd - j0);
+            }
+        }
+    }
+
+    int n;
+    std::vector<int> dist;
+    std::vector<int> hop;
+};
+
+#endif // ROUTING_FLOYD_WARSHALL_H
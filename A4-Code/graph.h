@@ -0,0 +1,141 @@
+// Sparse topology shared by the DVR and LSR simulations.
+//
+// The simulations only ever walk the links of a node, so whatever the input
+// format (see loader.h), the topology is kept in compressed sparse row (CSR)
+// form: the links of node u are targets[offsets[u] .. offsets[u+1])
+// with the matching entries of costs. Walking a node's links costs its degree
+// instead of n, and the arrays are contiguous, so large sparse topologies fit
+// in memory and in cache.
+
+#ifndef ROUTING_GRAPH_H
+#define ROUTING_GRAPH_H
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+const int INF = 9999;  // "no link" in the input matrix
+
+// Distance of a destination nobody has a route to yet. Kept far above any
+// real path cost, so that long paths in large topologies are not mistaken for
+// INF, and low enough that adding a link cost to it cannot overflow.
+const int UNREACHABLE = std::numeric_limits<int>::max() / 2;
+
+// Dearest link cost the loader accepts for n nodes. A route crosses at most
+// n - 1 links, so no path cost can then reach UNREACHABLE.
+inline int maxLinkCost(int n) { return (UNREACHABLE - 1) / std::max(n - 1, 1); }
+
+struct Edge {
+    int from;
+    int to;
+    int cost;
+};
+
+inline bool isLink(const Edge& e) { return e.from != e.to && e.cost != INF && e.cost != 0; }
+
+struct Graph {
+    int n = 0;
+    std::vector<int> offsets;  // n + 1 entries
+    std::vector<int> targets;
+    std::vector<int> costs;
+
+    int degree(int u) const { return offsets[u + 1] - offsets[u]; }
+
+    // Builds the graph from links u -> v in any order. As in the matrix
+    // format, a cost of 0 or INF is not a link, and neither is u -> u.
+    // Parallel links keep the cheapest. Each node's links end up sorted by
+    // target, the order a matrix row lists them in.
+    static Graph fromEdges(int n, const std::vector<Edge>& edges) {
+        Graph g;
+        g.n = n;
+        g.offsets.assign(n + 1, 0);
+        for (const Edge& e : edges) {
+            if (isLink(e)) g.offsets[e.from + 1]++;
+        }
+        for (int u = 0; u < n; ++u) g.offsets[u + 1] += g.offsets[u];
+        g.targets.resize(g.offsets[n]);
+        g.costs.resize(g.offsets[n]);
+        std::vector<int> fill(g.offsets.begin(), g.offsets.end() - 1);
+        bool sorted = true;
+        for (const Edge& e : edges) {
+            if (!isLink(e)) continue;
+            int slot = fill[e.from]++;
+            g.targets[slot] = e.to;
+            g.costs[slot] = e.cost;
+            if (slot > g.offsets[e.from] && g.targets[slot - 1] >= e.to) sorted = false;
+        }
+
+        // Sort each node's links and merge parallel ones in place; matrix
+        // input is already sorted
+        std::vector<std::pair<int, int>> scratch;
+        int begin = 0, kept = 0;
+        for (int u = 0; u < n; ++u) {
+            int end = g.offsets[u + 1];
+            if (!sorted) g.sortLinks(begin, end, scratch);
+            g.offsets[u] = kept;
+            for (int e = begin; e < end; ++e) {
+                if (e > begin && g.targets[e] == g.targets[e - 1]) {
+                    g.costs[kept - 1] = std::min(g.costs[kept - 1], g.costs[e]);
+                    continue;
+                }
+                g.targets[kept] = g.targets[e];
+                g.costs[kept] = g.costs[e];
+                ++kept;
+            }
+            begin = end;
+        }
+        g.offsets[n] = kept;
+        g.targets.resize(kept);
+        g.costs.resize(kept);
+        return g;
+    }
+
+    // The same links with every direction reversed: the links of u in the
+    // result are the nodes that have a link to u.
+    Graph transpose() const {
+        Graph t;
+        t.n = n;
+        t.offsets.assign(n + 1, 0);
+        for (int v : targets) t.offsets[v + 1]++;
+        for (int u = 0; u < n; ++u) t.offsets[u + 1] += t.offsets[u];
+        t.targets.resize(targets.size());
+        t.costs.resize(costs.size());
+        std::vector<int> fill(t.offsets.begin(), t.offsets.end() - 1);
+        for (int u = 0; u < n; ++u) {
+            for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+                int slot = fill[targets[e]]++;
+                t.targets[slot] = u;
+                t.costs[slot] = costs[e];
+            }
+        }
+        return t;
+    }
+
+private:
+    // Sorts links [begin, end) by target. Most nodes have a handful of links,
+    // which insertion sort handles without leaving the two arrays.
+    void sortLinks(int begin, int end, std::vector<std::pair<int, int>>& scratch) {
+        if (end - begin <= 16) {
+            for (int i = begin + 1; i < end; ++i) {
+                int t = targets[i], c = costs[i], j = i;
+                for (; j > begin && targets[j - 1] > t; --j) {
+                    targets[j] = targets[j - 1];
+                    costs[j] = costs[j - 1];
+                }
+                targets[j] = t;
+                costs[j] = c;
+            }
+            return;
+        }
+        scratch.clear();
+        for (int i = begin; i < end; ++i) scratch.push_back({targets[i], costs[i]});
+        std::sort(scratch.begin(), scratch.end());
+        for (int i = begin; i < end; ++i) {
+            targets[i] = scratch[i - begin].first;
+            costs[i] = scratch[i - begin].second;
+        }
+    }
+};
+
+#endif // ROUTING_GRAPH_H
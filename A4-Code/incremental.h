@@ -0,0 +1,371 @@
+// Incremental routing for link events: links going down, coming up or
+// changing cost while the tables are live.
+//
+// Both engines start from the converged tables of the static simulations and
+// then repair only what an event invalidates. Both keep full n x n tables, so
+// event mode is limited to topologies that fit in one DVR block (see
+// dvrBlockWidth).
+//
+// DvrNetwork runs triggered updates. A node recomputes an entry only when a
+// neighbour's entry for the same destination changed, taking the cheapest of
+// "link cost + what the neighbour advertises" over all of its links. The
+// recomputation happens in synchronous rounds, so "rounds" is the
+// convergence time in exchange periods. Advertisements use split horizon
+// with poisoned reverse: a neighbour whose route to k goes through i tells i
+// that k is unreachable. That stops two-node loops from counting to infinity
+// when a link fails. Longer loops still count up, as in RIP, until routes
+// reach DV infinity. That is LinkTable::dvInfinity(): INF (9999), or more
+// when the current links allow a loop-free route of 9999 or more, so no real
+// route is ever cut off.
+//
+// IncrementalLsr keeps a shortest-path tree per source, as parent pointers.
+// A cheaper link reruns Dijkstra from its far end only, and only while costs
+// improve. A dearer or failed link that the tree uses invalidates the subtree
+// below it. The subtree is reattached from the rest of the tree and finished
+// with a Dijkstra restricted to it. Sources are repaired in parallel.
+
+#ifndef ROUTING_INCREMENTAL_H
+#define ROUTING_INCREMENTAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "dvr.h"
+#include "graph.h"
+#include "lsr.h"
+#include "thread_pool.h"
+
+// Links that can change at run time, kept in both directions.
+class LinkTable {
+public:
+    struct Link {
+        int node;  // the neighbour
+        int cost;
+    };
+
+    explicit LinkTable(const Graph& g) : out(g.n), in(g.n) {
+        for (int u = 0; u < g.n; ++u) {
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) set(u, g.targets[e], g.costs[e]);
+        }
+    }
+
+    int size() const { return out.size(); }
+    const std::vector<Link>& linksFrom(int u) const { return out[u]; }
+    const std::vector<Link>& linksTo(int v) const { return in[v]; }
+
+    // Cost of the link u -> v, or UNREACHABLE if there is none.
+    int cost(int u, int v) const {
+        auto it = find(out[u], v);
+        return it != out[u].end() && it->node == v ? it->cost : UNREACHABLE;
+    }
+
+    // Sets the cost of u -> v; UNREACHABLE removes the link.
+    void set(int u, int v, int cost) {
+        update(out[u], v, cost);
+        update(in[v], u, cost);
+    }
+
+    // The cost distance vectors count up to before a route is unreachable:
+    // INF, or above the n - 1 dearest links together if that is more, since
+    // no loop-free route crosses more links than that.
+    int dvInfinity() const {
+        std::vector<int> costs;
+        for (const std::vector<Link>& links : out) {
+            for (const Link& l : links) costs.push_back(l.cost);
+        }
+        size_t longest = std::min(costs.size(), out.empty() ? size_t(0) : out.size() - 1);
+        std::nth_element(costs.begin(), costs.begin() + longest, costs.end(), std::greater<int>());
+        int64_t bound = 1;
+        for (size_t i = 0; i < longest; ++i) bound += costs[i];
+        return int(std::min<int64_t>(std::max<int64_t>(bound, INF), UNREACHABLE));
+    }
+
+    // The current links as a Graph, for the static engines.
+    Graph graph() const {
+        std::vector<Edge> edges;
+        for (int u = 0; u < size(); ++u) {
+            for (const Link& l : out[u]) edges.push_back({u, l.node, l.cost});
+        }
+        return Graph::fromEdges(size(), edges);
+    }
+
+private:
+    static std::vector<Link>::const_iterator find(const std::vector<Link>& links, int node) {
+        return std::lower_bound(links.begin(), links.end(), node,
+                                [](const Link& l, int n) { return l.node < n; });
+    }
+    static void update(std::vector<Link>& links, int node, int cost) {
+        auto it = links.begin() + (find(links, node) - links.begin());
+        bool present = it != links.end() && it->node == node;
+        if (cost == UNREACHABLE) {
+            if (present) links.erase(it);
+        } else if (present) {
+            it->cost = cost;
+        } else {
+            links.insert(it, {node, cost});
+        }
+    }
+
+    std::vector<std::vector<Link>> out;  // sorted by neighbour
+    std::vector<std::vector<Link>> in;
+};
+
+class DvrNetwork {
+public:
+    struct Convergence {
+        int rounds = 0;
+        int64_t changedEntries = 0;  // distinct (node, destination) pairs
+    };
+
+    // Starts from the converged tables of the static engine.
+    DvrNetwork(const Graph& graph, const LinkTable& links)
+        : links(links), n(graph.n), infinity(links.dvInfinity()), dist(size_t(n) * n), hop(size_t(n) * n) {
+        DvrEngine dvr(graph, 0, n);
+        while (dvr.step()) {}
+        for (int i = 0; i < n; ++i) {
+            for (int k = 0; k < n; ++k) {
+                size_t e = entry(i, k);
+                dist[e] = dvr.cost(i, k);
+                hop[e] = dist[e] == UNREACHABLE ? -1 : dvr.nextHop(i, k);
+            }
+        }
+    }
+
+    // Reconverges after the links of the given nodes changed (already
+    // applied to the LinkTable). Every entry of those nodes is recomputed
+    // first; after that only neighbours of changed entries are.
+    Convergence linksChanged(const std::vector<int>& nodes) {
+        Convergence result;
+        infinity = links.dvInfinity();
+        std::vector<int64_t> pending, touched;
+        for (int u : nodes) {
+            for (int k = 0; k < n; ++k) pending.push_back(entry(u, k));
+        }
+        std::vector<Update> updates;
+        while (!pending.empty()) {
+            std::sort(pending.begin(), pending.end());
+            pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+            // 1) Recompute every pending entry from last round's advertisements
+            updates.clear();
+            for (int64_t e : pending) {
+                int i = e / n, k = e % n;
+                Update u = recompute(i, k);
+                if (u.dist != dist[e] || u.hop != hop[e]) updates.push_back(u);
+            }
+            if (updates.empty()) break;
+            ++result.rounds;
+
+            // 2) Apply them together; each change is a triggered update to
+            //    every node with a link to the changed one
+            pending.clear();
+            for (const Update& u : updates) {
+                size_t e = entry(u.node, u.dest);
+                dist[e] = u.dist;
+                hop[e] = u.hop;
+                touched.push_back(e);
+                for (const LinkTable::Link& l : links.linksTo(u.node)) pending.push_back(entry(l.node, u.dest));
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        result.changedEntries = std::unique(touched.begin(), touched.end()) - touched.begin();
+        return result;
+    }
+
+    // The same accessors as DvrEngine, for TableWriter.
+    int firstDest() const { return 0; }
+    int blockWidth() const { return n; }
+    int cost(int node, int d) const { return dist[entry(node, d)]; }
+    int nextHop(int node, int d) const { return hop[entry(node, d)]; }
+
+private:
+    struct Update {
+        int node;
+        int dest;
+        int dist;
+        int hop;
+    };
+
+    size_t entry(int i, int k) const { return size_t(i) * n + k; }
+
+    // Best route from i to k over i's links, as its neighbours advertise it.
+    // On a tie the current next hop is kept, so equal-cost routes do not flap.
+    Update recompute(int i, int k) const {
+        Update best{i, k, UNREACHABLE, -1};
+        if (i == k) {
+            best.dist = 0;
+            return best;
+        }
+        int current = hop[entry(i, k)];
+        for (const LinkTable::Link& l : links.linksFrom(i)) {
+            size_t e = entry(l.node, k);
+            if (hop[e] == i || dist[e] == UNREACHABLE) continue;  // poisoned reverse
+            int cost = l.cost + dist[e];
+            if (cost >= infinity) continue;
+            if (cost < best.dist || (cost == best.dist && l.node == current)) {
+                best.dist = cost;
+                best.hop = l.node;
+            }
+        }
+        return best;
+    }
+
+    const LinkTable& links;
+    int n;
+    int infinity;  // links.dvInfinity() as of the last change
+    std::vector<int> dist;
+    std::vector<int> hop;
+};
+
+class IncrementalLsr {
+public:
+    // Starts from a full Dijkstra per source.
+    IncrementalLsr(const Graph& graph, const LinkTable& links, ThreadPool& pool)
+        : links(links), pool(pool), n(graph.n), dist(size_t(n) * n), firstHop(size_t(n) * n),
+          parent(size_t(n) * n), scratch(pool.size()) {
+        std::vector<LsrWorker> workers(pool.size());
+        pool.parallelFor(n, [&](int s, int w) {
+            workers[w].run(graph, s, row(dist, s), row(firstHop, s), row(parent, s));
+        });
+    }
+
+    // Repairs every source's tree after link u -> v changed from oldCost to
+    // its cost in the LinkTable. Returns the number of (source, destination)
+    // entries whose cost or first hop changed.
+    int64_t linkChanged(int u, int v, int oldCost) {
+        int newCost = links.cost(u, v);
+        if (newCost == oldCost) return 0;
+        for (Scratch& s : scratch) s.changed = 0;
+        pool.parallelFor(n, [&](int src, int w) {
+            if (newCost < oldCost) {
+                improve(src, u, v, newCost, scratch[w]);
+            } else {
+                detach(src, u, v, scratch[w]);
+            }
+        });
+        int64_t changed = 0;
+        for (const Scratch& s : scratch) changed += s.changed;
+        return changed;
+    }
+
+    const int* costs() const { return dist.data(); }
+    const int* firstHops() const { return firstHop.data(); }
+    int cost(int src, int d) const { return dist[size_t(src) * n + d]; }
+    int nextHop(int src, int d) const { return firstHop[size_t(src) * n + d]; }
+
+private:
+    struct alignas(64) Scratch {
+        IndexedHeap heap;
+        std::vector<char> inSubtree;
+        std::vector<int> subtree;
+        std::vector<std::pair<int, int>> before;  // old (cost, first hop) of the subtree
+        int64_t changed = 0;
+    };
+
+    int* row(std::vector<int>& table, int s) { return table.data() + size_t(s) * n; }
+
+    // The link got cheaper (or came up): if it shortens the path to v, run
+    // Dijkstra outward from v for as long as routes keep improving.
+    void improve(int s, int u, int v, int cost, Scratch& scratch) {
+        int* d = row(dist, s);
+        if (d[u] == UNREACHABLE || d[u] + cost >= d[v]) return;
+        int* fh = row(firstHop, s);
+        int* p = row(parent, s);
+        scratch.heap.reserve(n);
+        scratch.inSubtree.resize(n, 0);
+        scratch.subtree.clear();  // here: the nodes that improved
+        auto lower = [&](int x, int from, int c) {
+            d[x] = c;
+            fh[x] = from == s ? x : fh[from];
+            p[x] = from;
+            scratch.heap.push(x, c);
+            if (!scratch.inSubtree[x]) {
+                scratch.inSubtree[x] = 1;
+                scratch.subtree.push_back(x);
+            }
+        };
+        lower(v, u, d[u] + cost);
+        while (!scratch.heap.empty()) {
+            int x = scratch.heap.pop();
+            for (const LinkTable::Link& l : links.linksFrom(x)) {
+                if (d[x] + l.cost < d[l.node]) lower(l.node, x, d[x] + l.cost);
+            }
+        }
+        scratch.changed += scratch.subtree.size();
+        for (int x : scratch.subtree) scratch.inSubtree[x] = 0;
+    }
+
+    // The link got dearer (or went down): if the tree uses it, every node
+    // below v loses its route. Reattach each one to the cheapest neighbour
+    // outside the subtree, then settle the subtree with Dijkstra.
+    void detach(int s, int u, int v, Scratch& scratch) {
+        int* d = row(dist, s);
+        int* fh = row(firstHop, s);
+        int* p = row(parent, s);
+        if (p[v] != u) return;
+
+        // 1) Collect the subtree below v
+        scratch.inSubtree.resize(n, 0);
+        scratch.subtree.assign(1, v);
+        scratch.inSubtree[v] = 1;
+        for (size_t i = 0; i < scratch.subtree.size(); ++i) {
+            int y = scratch.subtree[i];
+            for (const LinkTable::Link& l : links.linksFrom(y)) {
+                if (p[l.node] == y && !scratch.inSubtree[l.node]) {
+                    scratch.inSubtree[l.node] = 1;
+                    scratch.subtree.push_back(l.node);
+                }
+            }
+        }
+
+        // 2) Forget their routes and take the best way in from outside
+        scratch.before.clear();
+        for (int a : scratch.subtree) {
+            scratch.before.push_back({d[a], fh[a]});
+            d[a] = UNREACHABLE;
+            fh[a] = p[a] = -1;
+        }
+        scratch.heap.reserve(n);
+        for (int a : scratch.subtree) {
+            for (const LinkTable::Link& l : links.linksTo(a)) {
+                int w = l.node;
+                if (scratch.inSubtree[w] || d[w] == UNREACHABLE || d[w] + l.cost >= d[a]) continue;
+                d[a] = d[w] + l.cost;
+                fh[a] = w == s ? a : fh[w];
+                p[a] = w;
+            }
+            if (d[a] != UNREACHABLE) scratch.heap.push(a, d[a]);
+        }
+
+        // 3) Settle the subtree; nothing outside it can get cheaper
+        while (!scratch.heap.empty()) {
+            int x = scratch.heap.pop();
+            for (const LinkTable::Link& l : links.linksFrom(x)) {
+                int c = d[x] + l.cost;
+                if (!scratch.inSubtree[l.node] || c >= d[l.node]) continue;
+                d[l.node] = c;
+                fh[l.node] = x == s ? l.node : fh[x];
+                p[l.node] = x;
+                scratch.heap.push(l.node, c);
+            }
+        }
+
+        for (size_t i = 0; i < scratch.subtree.size(); ++i) {
+            int a = scratch.subtree[i];
+            if (scratch.before[i] != std::make_pair(d[a], fh[a])) scratch.changed++;
+            scratch.inSubtree[a] = 0;
+        }
+    }
+
+    const LinkTable& links;
+    ThreadPool& pool;
+    int n;
+    std::vector<int> dist;
+    std::vector<int> firstHop;
+    std::vector<int> parent;
+    std::vector<Scratch> scratch;
+};
+
+#endif // ROUTING_INCREMENTAL_H
@@ -0,0 +1,290 @@
+// Topology loading and saving.
+//
+// loadGraph reads three formats, told apart by how the file starts:
+//  - Binary CSR: the GraphFileHeader below, followed by the offsets,
+//    targets and costs arrays of the Graph as int32 in host byte order. The
+//    file is memory-mapped and the arrays are copied out in one pass each.
+//  - Edge list: a first line of "n m", then m lines "u v cost", each a link
+//    from u to v. A two-way link needs a line in each direction.
+//  - Matrix: a first line holding only n, then the n x n cost matrix. The
+//    matrix may also start on the first line, or be all on one line: when
+//    more than two integers follow on the first line, the file is a matrix if
+//    exactly n x n integers follow n, and an edge list otherwise.
+// In both text formats a cost of 0 or INF (9999) is not a link, exactly as in
+// the matrix, and '#' starts a comment that runs to the end of the line.
+// Every format rejects link costs outside 1..maxLinkCost(n), other than the
+// text formats' 0 and INF for "no link".
+//
+// Text is parsed straight out of the mapped file by a hand-rolled integer
+// scanner; no stream or per-line string is involved.
+
+#ifndef ROUTING_LOADER_H
+#define ROUTING_LOADER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "graph.h"
+
+namespace graph_file {
+
+const char MAGIC[4] = {'R', 'C', 'S', 'R'};
+const uint32_t VERSION = 1;
+
+struct GraphFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n;
+    uint32_t links;
+};
+
+[[noreturn]] inline void fail(const std::string& message) {
+    std::cerr << "Error: " << message << std::endl;
+    std::exit(1);
+}
+
+// A read-only mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) fail("Could not open file " + path);
+        size = st.st_size;
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (p == MAP_FAILED) fail("Could not map file " + path);
+            data = static_cast<const char*>(p);
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// Reads integers from a text buffer, skipping whitespace and comments.
+class Scanner {
+public:
+    // Byte offsets in errors count from origin, by default the start of the text.
+    Scanner(const char* begin, const char* end, const std::string& path, const char* origin = nullptr)
+        : p(begin), end(end), start(origin ? origin : begin), path(path) {}
+
+    bool atEnd() {
+        skip(true);
+        return p == end;
+    }
+    // True if another integer follows on the current line.
+    bool moreOnLine() {
+        skip(false);
+        return p != end && *p != '\n';
+    }
+    int next(const char* what) {
+        skip(true);
+        const char* begin = p;
+        bool negative = p != end && *p == '-';
+        if (negative) ++p;
+        const char* digits = p;
+        int64_t value = 0;
+        while (p != end && unsigned(*p - '0') < 10 && p - digits < 10) value = value * 10 + (*p++ - '0');
+        if (p == digits || value > INT32_MAX || (p != end && unsigned(*p - '0') < 10)) {
+            p = begin;
+            fail(std::string("expected ") + what + " at byte " + std::to_string(offset()) + " of " + path);
+        }
+        return negative ? -int(value) : int(value);
+    }
+    size_t offset() const { return p - start; }
+
+private:
+    void skip(bool newlines) {
+        for (;;) {
+            while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || (newlines && *p == '\n'))) ++p;
+            if (p == end || *p != '#') return;
+            while (p != end && *p != '\n') ++p;
+        }
+    }
+
+    const char* p;
+    const char* end;
+    const char* start;
+    const std::string& path;
+};
+
+// Fails unless cost is a usable link cost for an n-node topology. In the text
+// formats, 0 and INF mean "no link" and are not passed here.
+inline void checkCost(int cost, int n, const std::string& where, bool text) {
+    if (cost < 1 || cost > maxLinkCost(n)) {
+        std::string noLink = text ? " (0 and " + std::to_string(INF) + " mean no link)" : "";
+        fail("link cost " + std::to_string(cost) + " " + where + " is outside 1.." + std::to_string(maxLinkCost(n)) +
+             " for " + std::to_string(n) + " nodes" + noLink);
+    }
+}
+
+// Whether the text after n (the first integer, already read) is an edge
+// list rather than a matrix; see the format notes at the top.
+inline bool isEdgeList(Scanner in, int n) {
+    if (!in.moreOnLine()) return false;
+    in.next("link count");
+    if (!in.moreOnLine()) return true;
+    int64_t count = 1;
+    while (!in.atEnd() && count <= int64_t(n) * n) {
+        in.next("integer");
+        ++count;
+    }
+    return count != int64_t(n) * n;
+}
+
+inline Graph loadBinary(const MappedFile& file, const std::string& path) {
+    GraphFileHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    size_t expected = sizeof(header) + (size_t(header.n) + 1 + 2 * size_t(header.links)) * sizeof(int32_t);
+    if (header.version != VERSION || file.size != expected) fail("Corrupt graph file " + path);
+
+    Graph g;
+    g.n = header.n;
+    const int32_t* arrays = reinterpret_cast<const int32_t*>(file.data + sizeof(header));
+    g.offsets.assign(arrays, arrays + header.n + 1);
+    g.targets.assign(arrays + header.n + 1, arrays + header.n + 1 + header.links);
+    g.costs.assign(arrays + header.n + 1 + header.links, arrays + header.n + 1 + 2 * size_t(header.links));
+    if (g.offsets[0] != 0 || g.offsets[g.n] != int(header.links)) fail("Corrupt graph file " + path);
+    for (int u = 0; u < g.n; ++u) {
+        if (g.offsets[u] > g.offsets[u + 1]) fail("Corrupt graph file " + path);
+    }
+    for (int v : g.targets) {
+        if (v < 0 || v >= g.n) fail("Corrupt graph file " + path);
+    }
+    for (int c : g.costs) {
+        if (c == 0) fail("Corrupt graph file " + path);
+        checkCost(c, g.n, "in " + path, false);
+    }
+    return g;
+}
+
+} // namespace graph_file
+
+inline Graph loadGraph(const std::string& path) {
+    using namespace graph_file;
+    MappedFile file(path);
+    if (file.size >= sizeof(GraphFileHeader) && std::memcmp(file.data, MAGIC, 4) == 0) {
+        return loadBinary(file, path);
+    }
+
+    Scanner in(file.data, file.data + file.size, path);
+    int n = in.next("node count");
+    if (n < 0) fail("negative node count in " + path);
+    std::vector<Edge> edges;
+    if (isEdgeList(in, n)) {
+        // 1) Edge list: "u v cost" per link
+        int m = in.next("link count");
+        // Every link takes at least 5 bytes ("u v c" and a separator)
+        if (m < 0 || size_t(m) > file.size / 5 + 1) fail("bad link count in " + path);
+        edges.resize(m);
+        for (Edge& e : edges) {
+            e.from = in.next("source node");
+            e.to = in.next("target node");
+            e.cost = in.next("link cost");
+            if (e.cost != 0 && e.cost != INF) {
+                checkCost(e.cost, n, "at byte " + std::to_string(in.offset()) + " of " + path, true);
+            }
+            if (e.from < 0 || e.from >= n || e.to < 0 || e.to >= n) {
+                fail("node out of range at byte " + std::to_string(in.offset()) + " of " + path);
+            }
+        }
+    } else {
+        // 2) Matrix: entry (i, j) is the cost of the link from i to j
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                int cost = in.next("matrix entry");
+                if (cost != 0 && cost != INF) {
+                    checkCost(cost, n, "at byte " + std::to_string(in.offset()) + " of " + path, true);
+                }
+                if (isLink({i, j, cost})) edges.push_back({i, j, cost});
+            }
+        }
+    }
+    if (!in.atEnd()) fail("unexpected data at byte " + std::to_string(in.offset()) + " of " + path);
+    return Graph::fromEdges(n, edges);
+}
+
+// One line of a link event file:
+//   down u v          the link between u and v fails
+//   up u v cost       the link comes up with this cost
+//   cost u v cost     the link's cost changes
+// An event applies to both directions of the link. As in the topology, a cost
+// of 0 or INF takes the link down.
+struct LinkEvent {
+    std::string kind;
+    int u;
+    int v;
+    int cost;  // UNREACHABLE for down
+};
+
+inline std::vector<LinkEvent> loadEvents(const std::string& path, int n) {
+    using namespace graph_file;
+    MappedFile file(path);
+    std::vector<LinkEvent> events;
+    const char* p = file.data;
+    const char* end = p + file.size;
+    while (p != end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        const char* word = p;
+        while (word != eol && (*word == ' ' || *word == '\t')) ++word;
+        const char* wordEnd = word;
+        while (wordEnd != eol && *wordEnd >= 'a' && *wordEnd <= 'z') ++wordEnd;
+        std::string kind(word, wordEnd);
+        p = eol == end ? end : eol + 1;
+        if (kind.empty()) {
+            if (!Scanner(word, eol, path, file.data).atEnd()) fail("bad event at byte " + std::to_string(word - file.data) + " of " + path);
+            continue;
+        }
+        Scanner args(wordEnd, eol, path, file.data);
+        LinkEvent e{kind, args.next("node"), args.next("node"), UNREACHABLE};
+        if (kind == "up" || kind == "cost") {
+            e.cost = args.next("link cost");
+            if (e.cost != 0 && e.cost != INF) {
+                checkCost(e.cost, n, "at byte " + std::to_string(args.offset()) + " of " + path, true);
+            }
+            if (e.cost == 0 || e.cost == INF) e.cost = UNREACHABLE;
+        } else if (kind != "down") {
+            fail("unknown event '" + kind + "' at byte " + std::to_string(word - file.data) + " of " + path);
+        }
+        if (!args.atEnd() || e.u < 0 || e.u >= n || e.v < 0 || e.v >= n || e.u == e.v) {
+            fail("bad event at byte " + std::to_string(word - file.data) + " of " + path);
+        }
+        events.push_back(e);
+    }
+    return events;
+}
+
+// Writes g in the binary CSR format.
+inline void saveGraph(const Graph& g, const std::string& path) {
+    using namespace graph_file;
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) fail("Could not open file " + path);
+    GraphFileHeader header{};
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.n = g.n;
+    header.links = g.targets.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+              std::fwrite(g.offsets.data(), sizeof(int), g.offsets.size(), out) == g.offsets.size() &&
+              std::fwrite(g.targets.data(), sizeof(int), g.targets.size(), out) == g.targets.size() &&
+              std::fwrite(g.costs.data(), sizeof(int), g.costs.size(), out) == g.costs.size();
+    if (std::fclose(out) != 0 || !ok) fail("Could not write " + path);
+}
+
+#endif // ROUTING_LOADER_H
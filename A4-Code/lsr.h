@@ -0,0 +1,154 @@
+// Link state routing engine: Dijkstra from every source over the CSR graph.
+//
+// The frontier is an indexed 4-ary heap. Each node has at most one entry, and
+// a cheaper route moves that entry up in place instead of pushing a duplicate,
+// so the heap never holds more than n entries and nothing is popped stale.
+// Ties are broken by node number, the same order the old pair-based priority
+// queue used, so the chosen paths do not change.
+//
+// Each thread keeps one LsrWorker and reuses its heap for every source it
+// runs. The results go straight into caller-owned rows of costs and first
+// hops. The first hop is carried along as nodes are settled, so the routing
+// table needs no walk back along the predecessors.
+
+#ifndef ROUTING_LSR_H
+#define ROUTING_LSR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "graph.h"
+
+#define LSR_BATCH_BYTES (64 << 20)  // result rows buffered between prints
+
+class IndexedHeap {
+public:
+    void reserve(int n) {
+        if (int(pos.size()) < n) pos.assign(n, -1);
+        entries.reserve(n);
+    }
+    bool empty() const { return entries.empty(); }
+
+    // Inserts node, or lowers its key if it is already queued.
+    void push(int node, int key) {
+        int i = pos[node];
+        if (i < 0) {
+            i = entries.size();
+            entries.push_back({key, node});
+        } else {
+            entries[i].key = key;
+        }
+        siftUp(i);
+    }
+
+    // Removes and returns the node with the smallest (key, node).
+    int pop() {
+        int top = entries[0].node;
+        pos[top] = -1;
+        Entry last = entries.back();
+        entries.pop_back();
+        if (!entries.empty()) {
+            entries[0] = last;
+            pos[last.node] = 0;
+            siftDown(0);
+        }
+        return top;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int node;
+        bool operator<(const Entry& o) const { return key < o.key || (key == o.key && node < o.node); }
+    };
+    static const int ARITY = 4;
+
+    void siftUp(int i) {
+        Entry e = entries[i];
+        while (i > 0) {
+            int parent = (i - 1) / ARITY;
+            if (!(e < entries[parent])) break;
+            place(i, entries[parent]);
+            i = parent;
+        }
+        place(i, e);
+    }
+
+    void siftDown(int i) {
+        Entry e = entries[i];
+        int size = entries.size();
+        for (;;) {
+            int first = i * ARITY + 1;
+            if (first >= size) break;
+            int best = first;
+            int last = std::min(first + ARITY, size);
+            for (int c = first + 1; c < last; ++c) {
+                if (entries[c] < entries[best]) best = c;
+            }
+            if (!(entries[best] < e)) break;
+            place(i, entries[best]);
+            i = best;
+        }
+        place(i, e);
+    }
+
+    void place(int i, const Entry& e) {
+        entries[i] = e;
+        pos[e.node] = i;
+    }
+
+    std::vector<Entry> entries;
+    std::vector<int> pos;  // index in entries, or -1 if not queued
+};
+
+class LsrWorker {
+public:
+    // Shortest paths from src. dist[v] becomes the cost to v (UNREACHABLE if
+    // there is no path) and firstHop[v] the neighbour of src the path leaves
+    // through (-1 for src itself and unreachable nodes). If parent is given,
+    // parent[v] becomes the node before v on the path, or -1.
+    void run(const Graph& g, int src, int* dist, int* firstHop, int* parent = nullptr) {
+        heap.reserve(g.n);
+        std::fill(dist, dist + g.n, UNREACHABLE);
+        std::fill(firstHop, firstHop + g.n, -1);
+        if (parent) std::fill(parent, parent + g.n, -1);
+
+        dist[src] = 0;
+        heap.push(src, 0);
+        order.clear();
+        while (!heap.empty()) {
+            int u = heap.pop();
+            order.push_back(u);
+            int du = dist[u];
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                int v = g.targets[e];
+                // Saturates like minplus.h: a sum past UNREACHABLE stays unreached
+                if (g.costs[e] >= UNREACHABLE - du) continue;
+                int cost = du + g.costs[e];
+                if (cost < dist[v]) {
+                    dist[v] = cost;
+                    firstHop[v] = u == src ? v : firstHop[u];
+                    if (parent) parent[v] = u;
+                    heap.push(v, cost);
+                }
+            }
+        }
+    }
+
+    // Nodes the last run reached, in the order they were settled: by cost,
+    // so every node comes after the nodes on its shortest paths.
+    const std::vector<int>& settled() const { return order; }
+
+private:
+    IndexedHeap heap;
+    std::vector<int> order;
+};
+
+// Sources whose result rows are buffered at once: enough to keep every thread
+// busy, and no more than LSR_BATCH_BYTES.
+inline int lsrBatchSize(int n, int threads) {
+    int64_t rows = LSR_BATCH_BYTES / (int64_t(std::max(n, 1)) * 2 * sizeof(int));
+    return int(std::max<int64_t>(std::min<int64_t>(rows, n), std::min(threads, n)));
+}
+
+#endif // ROUTING_LSR_H
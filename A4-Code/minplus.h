@@ -0,0 +1,127 @@
+// Min-plus row update, the inner loop of both DVR and Floyd-Warshall:
+//   for every k: if add + via[k] < d[k], then d[k] = add + via[k], h[k] = hop
+// Returns whether any entry changed.
+//
+// There are three kernels, AVX2, SSE4.1 and portable scalar. The first call
+// picks the widest one the CPU supports. The x86 kernels are compiled with
+// target attributes, so the build needs no -m flags and the binary still runs
+// on CPUs without them. The vector kernels compare, take the minimum and blend
+// the next hop under the comparison mask, and they skip the stores for a
+// vector where nothing improved. That is most of them once DVR is close to
+// converging.
+//
+// The addition saturates at UNREACHABLE: via[k] is first capped at
+// UNREACHABLE - add, so no sum overflows, whatever the link costs, and one
+// that would pass the sentinel reads as unreachable instead of improving d[k].
+
+#ifndef ROUTING_MINPLUS_H
+#define ROUTING_MINPLUS_H
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "graph.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MINPLUS_X86 1
+#endif
+
+namespace minplus {
+
+using Kernel = bool (*)(int* __restrict d, int* __restrict h, const int* __restrict via, int add, int hop, int width);
+
+inline bool scalar(int* __restrict d, int* __restrict h, const int* __restrict via, int add, int hop, int width) {
+    add = std::min(add, UNREACHABLE);
+    int cap = UNREACHABLE - add, changed = 0;
+    for (int k = 0; k < width; ++k) {
+        int cost = std::min(via[k], cap) + add;
+        bool better = cost < d[k];
+        d[k] = better ? cost : d[k];
+        h[k] = better ? hop : h[k];
+        changed |= better;
+    }
+    return changed != 0;
+}
+
+#ifdef MINPLUS_X86
+__attribute__((target("sse4.1")))
+inline bool sse41(int* __restrict d, int* __restrict h, const int* __restrict via, int add, int hop, int width) {
+    add = std::min(add, UNREACHABLE);
+    __m128i vadd = _mm_set1_epi32(add), vcap = _mm_set1_epi32(UNREACHABLE - add);
+    __m128i vhop = _mm_set1_epi32(hop), any = _mm_setzero_si128();
+    int k = 0;
+    for (; k + 4 <= width; k += 4) {
+        __m128i cost = _mm_add_epi32(_mm_min_epi32(_mm_loadu_si128((const __m128i*)(via + k)), vcap), vadd);
+        __m128i cur = _mm_loadu_si128((const __m128i*)(d + k));
+        __m128i better = _mm_cmpgt_epi32(cur, cost);
+        if (_mm_testz_si128(better, better)) continue;
+        _mm_storeu_si128((__m128i*)(d + k), _mm_min_epi32(cur, cost));
+        __m128i hops = _mm_loadu_si128((const __m128i*)(h + k));
+        _mm_storeu_si128((__m128i*)(h + k), _mm_blendv_epi8(hops, vhop, better));
+        any = _mm_or_si128(any, better);
+    }
+    bool changed = !_mm_testz_si128(any, any);
+    return scalar(d + k, h + k, via + k, add, hop, width - k) || changed;
+}
+
+__attribute__((target("avx2")))
+inline bool avx2(int* __restrict d, int* __restrict h, const int* __restrict via, int add, int hop, int width) {
+    add = std::min(add, UNREACHABLE);
+    __m256i vadd = _mm256_set1_epi32(add), vcap = _mm256_set1_epi32(UNREACHABLE - add);
+    __m256i vhop = _mm256_set1_epi32(hop), any = _mm256_setzero_si256();
+    int k = 0;
+    for (; k + 8 <= width; k += 8) {
+        __m256i cost = _mm256_add_epi32(_mm256_min_epi32(_mm256_loadu_si256((const __m256i*)(via + k)), vcap), vadd);
+        __m256i cur = _mm256_loadu_si256((const __m256i*)(d + k));
+        __m256i better = _mm256_cmpgt_epi32(cur, cost);
+        if (_mm256_testz_si256(better, better)) continue;
+        _mm256_storeu_si256((__m256i*)(d + k), _mm256_min_epi32(cur, cost));
+        __m256i hops = _mm256_loadu_si256((const __m256i*)(h + k));
+        _mm256_storeu_si256((__m256i*)(h + k), _mm256_blendv_epi8(hops, vhop, better));
+        any = _mm256_or_si256(any, better);
+    }
+    bool changed = !_mm256_testz_si256(any, any);
+    return scalar(d + k, h + k, via + k, add, hop, width - k) || changed;
+}
+#endif
+
+struct Dispatch {
+    Kernel kernel;
+    const char* name;
+};
+
+// Kernel by name: "avx2", "sse4.1" or "scalar", or "auto" for the widest
+// the CPU supports. Returns a null kernel if the name is unknown or the CPU
+// lacks the instructions.
+inline Dispatch find(const std::string& name) {
+#ifdef MINPLUS_X86
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2"), hasSse41 = __builtin_cpu_supports("sse4.1");
+    if ((name == "auto" || name == "avx2") && hasAvx2) return {avx2, "avx2"};
+    if ((name == "auto" || name == "sse4.1") && hasSse41) return {sse41, "sse4.1"};
+#endif
+    if (name == "auto" || name == "scalar") return {scalar, "scalar"};
+    return {nullptr, nullptr};
+}
+
+inline Dispatch& active() {
+    static Dispatch d = find("auto");
+    return d;
+}
+
+// Switches every later row update to the named kernel; false if unavailable.
+inline bool select(const std::string& name) {
+    Dispatch d = find(name);
+    if (d.kernel) active() = d;
+    return d.kernel != nullptr;
+}
+
+inline const char* name() { return active().name; }
+
+inline bool row(int* __restrict d, int* __restrict h, const int* __restrict via, int add, int hop, int width) {
+    return active().kernel(d, h, via, add, hop, width);
+}
+
+} // namespace minplus
+
+#endif // ROUTING_MINPLUS_H
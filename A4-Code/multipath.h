@@ -0,0 +1,209 @@
+// Multipath routing on top of the LSR engine: every equal-cost next hop
+// (ECMP), and the k shortest loop-free paths between two nodes (Yen).
+//
+// EcmpWorker runs the usual Dijkstra per source, then makes one pass over
+// the shortest-path DAG it implies: u -> v is on the DAG when
+// dist[u] + cost == dist[v]. A node's set of first hops is the union of its
+// DAG predecessors' sets, and nodes are visited in the order Dijkstra
+// settled them, so every predecessor is done before its successors. The
+// pass is one walk over the links per source, shared by all destinations.
+// A set is a bitset over the source's own links, bit i for the link
+// targets[offsets[src] + i]. It takes ecmpWords(g) 64-bit words per
+// destination, usually one.
+//
+// YenPaths finds the k cheapest paths without repeated nodes. It starts
+// with one reverse Dijkstra from the destination, which gives the exact
+// remaining cost from every node. The first path is read off it directly.
+// Every spur search after that is an A* guided by it, so it only leaves the
+// optimal path where the removed links force it to. The search arrays are
+// allocated once and reset by generation stamps, not cleared per search.
+
+#ifndef ROUTING_MULTIPATH_H
+#define ROUTING_MULTIPATH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+#include "graph.h"
+#include "lsr.h"
+
+// 64-bit words per next-hop set: enough bits for the widest node's links.
+inline int ecmpWords(const Graph& g) {
+    int widest = 1;
+    for (int u = 0; u < g.n; ++u) widest = std::max(widest, g.degree(u));
+    return (widest + 63) / 64;
+}
+
+// Calls fn(node) for every next hop in src's set, in node order.
+template <class Fn>
+void forEachNextHop(const Graph& g, int src, const uint64_t* set, int words, Fn fn) {
+    for (int w = 0; w < words; ++w) {
+        for (uint64_t bits = set[w]; bits; bits &= bits - 1) {
+            fn(g.targets[g.offsets[src] + w * 64 + __builtin_ctzll(bits)]);
+        }
+    }
+}
+
+class EcmpWorker {
+public:
+    // Shortest paths from src. dist[v] is as for LsrWorker, and hops holds n
+    // sets of `words` words: set v is every neighbour of src that starts a
+    // shortest path to v (empty for src and unreachable nodes).
+    void run(const Graph& g, int src, int* dist, uint64_t* hops, int words) {
+        if (int(firstHop.size()) < g.n) firstHop.resize(g.n);
+        lsr.run(g, src, dist, firstHop.data());
+        std::fill(hops, hops + size_t(g.n) * words, 0);
+        for (int e = g.offsets[src]; e < g.offsets[src + 1]; ++e) {
+            int v = g.targets[e], slot = e - g.offsets[src];
+            if (dist[v] == g.costs[e]) hops[size_t(v) * words + slot / 64] |= uint64_t(1) << (slot % 64);
+        }
+        for (int u : lsr.settled()) {
+            if (u == src) continue;
+            const uint64_t* from = hops + size_t(u) * words;
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                int v = g.targets[e];
+                if (dist[u] + g.costs[e] != dist[v]) continue;
+                uint64_t* to = hops + size_t(v) * words;
+                for (int w = 0; w < words; ++w) to[w] |= from[w];
+            }
+        }
+    }
+
+private:
+    LsrWorker lsr;
+    std::vector<int> firstHop;  // LsrWorker's single next hops, unused here
+};
+
+struct Path {
+    int cost;
+    std::vector<int> nodes;
+    bool operator<(const Path& o) const { return cost < o.cost || (cost == o.cost && nodes < o.nodes); }
+};
+
+class YenPaths {
+public:
+    explicit YenPaths(const Graph& g)
+        : g(g), reverse(g.transpose()), toDest(g.n), firstHop(g.n), best(g.n), parent(g.n), seen(g.n, 0),
+          blocked(g.n, 0) {}
+
+    // Up to k loop-free paths from src to dst, cheapest first; ties go to
+    // the lexicographically smaller node sequence.
+    std::vector<Path> find(int src, int dst, int k) {
+        std::vector<Path> found;
+        // 1) Exact cost from every node to dst
+        reverseLsr.run(reverse, dst, toDest.data(), firstHop.data());
+        if (k <= 0 || toDest[src] == UNREACHABLE) return found;
+        found.push_back(follow(src, dst));
+
+        std::set<Path> candidates;
+        while (int(found.size()) < k) {
+            const std::vector<int> last = found.back().nodes;
+            // 2) Leave the last path at each of its nodes in turn
+            int rootCost = 0;
+            for (size_t j = 0; j + 1 < last.size(); ++j) {
+                int spurNode = last[j];
+                ++generation;
+                // The root may not be revisited, and no found path with the
+                // same root may be taken again
+                for (size_t r = 0; r < j; ++r) blocked[last[r]] = generation;
+                cut.clear();
+                for (const Path& p : found) {
+                    if (p.nodes.size() > j + 1 && std::equal(last.begin(), last.begin() + j + 1, p.nodes.begin())) {
+                        cut.push_back(p.nodes[j + 1]);
+                    }
+                }
+                Path spur;
+                if (search(spurNode, dst, spur)) {
+                    Path candidate{rootCost + spur.cost, std::vector<int>(last.begin(), last.begin() + j)};
+                    candidate.nodes.insert(candidate.nodes.end(), spur.nodes.begin(), spur.nodes.end());
+                    candidates.insert(std::move(candidate));
+                }
+                rootCost += linkCost(spurNode, last[j + 1]);
+            }
+            // 3) The cheapest candidate not yet taken is the next path
+            while (!candidates.empty() && std::find_if(found.begin(), found.end(), [&](const Path& p) {
+                       return p.nodes == candidates.begin()->nodes;
+                   }) != found.end()) {
+                candidates.erase(candidates.begin());
+            }
+            if (candidates.empty()) break;
+            found.push_back(*candidates.begin());
+            candidates.erase(candidates.begin());
+        }
+        return found;
+    }
+
+private:
+    int linkCost(int u, int v) const {
+        auto first = g.targets.begin() + g.offsets[u], last = g.targets.begin() + g.offsets[u + 1];
+        return g.costs[std::lower_bound(first, last, v) - g.targets.begin()];
+    }
+
+    // A shortest path, taking at every node the lowest-numbered link that
+    // stays on one.
+    Path follow(int src, int dst) const {
+        Path p{toDest[src], {src}};
+        for (int u = src; u != dst;) {
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                int v = g.targets[e];
+                if (toDest[v] != UNREACHABLE && g.costs[e] + toDest[v] == toDest[u]) {
+                    u = v;
+                    break;
+                }
+            }
+            p.nodes.push_back(u);
+        }
+        return p;
+    }
+
+    // A* from `from` to dst, avoiding blocked nodes and, out of `from`
+    // itself, the links to the nodes in cut.
+    bool search(int from, int dst, Path& out) {
+        heap.reserve(g.n);
+        best[from] = 0;
+        parent[from] = -1;
+        seen[from] = generation;
+        heap.push(from, toDest[from]);
+        bool reached = false;
+        while (!heap.empty()) {
+            int u = heap.pop();
+            if (u == dst) {
+                reached = true;
+                break;
+            }
+            for (int e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                int v = g.targets[e];
+                if (blocked[v] == generation || toDest[v] == UNREACHABLE) continue;
+                if (u == from && std::find(cut.begin(), cut.end(), v) != cut.end()) continue;
+                int cost = best[u] + g.costs[e];
+                if (seen[v] == generation && cost >= best[v]) continue;
+                seen[v] = generation;
+                best[v] = cost;
+                parent[v] = u;
+                heap.push(v, cost + toDest[v]);
+            }
+        }
+        while (!heap.empty()) heap.pop();
+        if (!reached) return false;
+        out.cost = best[dst];
+        out.nodes.clear();
+        for (int v = dst; v != -1; v = parent[v]) out.nodes.push_back(v);
+        std::reverse(out.nodes.begin(), out.nodes.end());
+        return true;
+    }
+
+    const Graph& g;
+    Graph reverse;
+    LsrWorker reverseLsr;
+    std::vector<int> toDest, firstHop;
+    // Spur search state, valid where seen / blocked equal generation
+    IndexedHeap heap;
+    std::vector<int> best, parent;
+    std::vector<uint32_t> seen, blocked;
+    uint32_t generation = 0;
+    std::vector<int> cut;
+};
+
+#endif // ROUTING_MULTIPATH_H
@@ -0,0 +1,388 @@
+// Routing table output for the simulations.
+//
+// Everything goes through one TableWriter, which formats into a 1 MiB buffer
+// and writes it out whole, so no line is flushed on its own. It has three
+// formats:
+//  - text: the "Node i Routing Table" blocks, as always.
+//  - csv: one "table,iteration,node,dest,cost,next_hop" row per entry.
+//    Iteration is the DVR round, or "final".
+//  - binary: a table file (layout below) that can be memory-mapped and
+//    indexed directly.
+// Independently, --iterations picks what DVR writes after every round: full
+// tables, only the entries that changed (delta), or nothing (none), leaving
+// just the final tables.
+//
+// In csv and binary output an unreachable destination has cost -1 and next
+// hop -1; text keeps printing INF and "-".
+//
+// Binary layout, in host byte order: a FileHeader, then sections. Each
+// section is a SectionHeader followed by its entries. A table section covers
+// nodes [firstNode, firstNode + nodes) and destinations [firstDest,
+// firstDest + dests). It holds nodes * dests Entry records, row by row, so
+// the entry for (node, dest) is at index
+// (node - firstNode) * dests + (dest - firstDest). A delta section holds
+// `nodes` Change records. So does an ECMP section, with one record per
+// equal-cost next hop, or one with next hop -1 where there is none.
+
+#ifndef ROUTING_OUTPUT_H
+#define ROUTING_OUTPUT_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "dvr.h"
+#include "multipath.h"
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+enum class OutputFormat { Text, Csv, Binary };
+enum class IterationDump { Full, Delta, None };
+
+struct OutputOptions {
+    OutputFormat format = OutputFormat::Text;
+    IterationDump iterations = IterationDump::Full;
+    std::string path;  // empty for standard output
+};
+
+namespace table_file {
+
+const char MAGIC[4] = {'R', 'T', 'B', 'L'};
+const uint32_t VERSION = 1;
+
+enum SectionKind : uint32_t {
+    DVR_ITERATION = 1,  // full DVR tables after round `iteration`
+    DVR_DELTA = 2,      // DVR entries changed in round `iteration`
+    DVR_FINAL = 3,
+    LSR_FINAL = 4,
+    LSR_ECMP = 5,       // Change records, one per (node, dest, next hop)
+};
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n;
+    uint32_t reserved;
+};
+
+struct SectionHeader {
+    uint32_t kind;
+    uint32_t iteration;  // 0 for final tables
+    uint32_t firstNode;
+    uint32_t nodes;      // row count, or record count for a delta
+    uint32_t firstDest;
+    uint32_t dests;      // 0 for a delta
+};
+
+struct Entry {
+    int32_t cost;
+    int32_t nextHop;
+};
+
+struct Change {
+    uint32_t node;
+    uint32_t dest;
+    int32_t cost;
+    int32_t nextHop;
+};
+
+} // namespace table_file
+
+class TableWriter {
+public:
+    TableWriter(const OutputOptions& options, int n) : options(options), n(n) {
+        if (options.path.empty()) {
+            out = stdout;
+        } else if (!(out = std::fopen(options.path.c_str(), "wb"))) {
+            std::cerr << "Error: Could not open file " << options.path << std::endl;
+            std::exit(1);
+        }
+        buf.reserve(OUTPUT_BUFFER_SIZE + 4096);
+        if (options.format == OutputFormat::Csv) {
+            append("table,iteration,node,dest,cost,next_hop\n");
+        } else if (options.format == OutputFormat::Binary) {
+            table_file::FileHeader header{};
+            std::memcpy(header.magic, table_file::MAGIC, 4);
+            header.version = table_file::VERSION;
+            header.n = n;
+            raw(&header, sizeof(header));
+        }
+    }
+
+    ~TableWriter() {
+        flush();
+        if (out != stdout) std::fclose(out);
+    }
+
+    // Text only: a "--- title ---" heading or a free-form line.
+    void heading(const char* title) {
+        if (options.format != OutputFormat::Text) return;
+        append("\n--- ");
+        append(title);
+        append(" ---\n");
+    }
+    void note(const std::string& line) {
+        if (options.format != OutputFormat::Text) return;
+        append(line.c_str());
+        append("\n");
+    }
+    // A line that belongs with the tables in text output and goes to stderr
+    // otherwise, such as a per-event report.
+    void report(const std::string& line) {
+        if (options.format == OutputFormat::Text) note(line);
+        else std::cerr << line << '\n';
+    }
+
+    // Writes what --iterations asks for after a DVR round. Text output needs
+    // whole tables, so it is skipped when the engine covers only some of the
+    // destinations.
+    void dvrIteration(const DvrEngine& dvr) {
+        if (options.iterations == IterationDump::None) return;
+        if (options.format == OutputFormat::Text && dvr.blockWidth() != n) return;
+        if (options.iterations == IterationDump::Delta) {
+            dvrDelta(dvr);
+            return;
+        }
+        if (options.format == OutputFormat::Text) {
+            append("Iteration ");
+            appendInt(dvr.rounds());
+            append(":\n");
+        }
+        dvrTables(dvr, table_file::DVR_ITERATION, dvr.rounds());
+    }
+
+    // Table is a DvrEngine or anything with the same accessors.
+    template <class Table>
+    void dvrFinal(const Table& dvr) {
+        if (options.format == OutputFormat::Text) {
+            if (dvr.blockWidth() != n) return;
+            append("--- DVR Final Tables ---\n");
+        }
+        dvrTables(dvr, table_file::DVR_FINAL, 0);
+    }
+
+    // Final LSR tables for sources [first, first + count); row i of dist and
+    // firstHop belongs to source first + i.
+    void lsrTables(int first, int count, const int* dist, const int* firstHop) {
+        if (options.format == OutputFormat::Binary) {
+            section(table_file::LSR_FINAL, 0, first, count, 0, n);
+        }
+        for (int i = 0; i < count; ++i) {
+            const int* d = dist + size_t(i) * n;
+            const int* h = firstHop + size_t(i) * n;
+            int src = first + i;
+            if (options.format == OutputFormat::Text) {
+                printLSRTable(src, d, h);
+                continue;
+            }
+            for (int dest = 0; dest < n; ++dest) entry("lsr", "final", src, dest, d[dest], h[dest]);
+        }
+    }
+
+    // Final ECMP tables for sources [first, first + count): row i of dist and
+    // of hops (n sets of `words` words, see multipath.h) belongs to source
+    // first + i. Every equal-cost next hop is listed, in node order.
+    void lsrEcmpTables(const Graph& g, int first, int count, const int* dist, const uint64_t* hops, int words) {
+        for (int i = 0; i < count; ++i) {
+            const int* d = dist + size_t(i) * n;
+            const uint64_t* h = hops + size_t(i) * n * words;
+            int src = first + i;
+            if (options.format == OutputFormat::Binary) {
+                uint32_t records = 0;
+                for (int dest = 0; dest < n; ++dest) {
+                    int setBits = 0;
+                    for (int w = 0; w < words; ++w) setBits += __builtin_popcountll(h[size_t(dest) * words + w]);
+                    records += std::max(setBits, 1);
+                }
+                section(table_file::LSR_ECMP, 0, src, records, 0, 0);
+            } else if (options.format == OutputFormat::Text) {
+                append("Node ");
+                appendInt(src);
+                append(" Routing Table:\nDest\tCost\tNext Hops\n");
+            }
+            for (int dest = 0; dest < n; ++dest) {
+                const uint64_t* set = h + size_t(dest) * words;
+                if (options.format == OutputFormat::Text) {
+                    if (dest == src) continue;
+                    appendInt(dest);
+                    append("\t");
+                    appendCost(d[dest]);
+                    const char* separator = "";
+                    forEachNextHop(g, src, set, words, [&](int hop) {
+                        append(separator);
+                        appendInt(hop);
+                        separator = " ";
+                    });
+                    append(*separator ? "\n" : "-\n");
+                    continue;
+                }
+                bool any = false;
+                forEachNextHop(g, src, set, words, [&](int hop) {
+                    ecmpEntry(src, dest, d[dest], hop);
+                    any = true;
+                });
+                if (!any) ecmpEntry(src, dest, d[dest], -1);
+            }
+            if (options.format == OutputFormat::Text) append("\n");
+        }
+    }
+
+private:
+    // One csv row or binary Change record of an ECMP table.
+    void ecmpEntry(int src, int dest, int cost, int hop) {
+        if (options.format == OutputFormat::Binary) {
+            table_file::Change change{uint32_t(src), uint32_t(dest), cost == UNREACHABLE ? -1 : cost, hop};
+            raw(&change, sizeof(change));
+        } else {
+            entry("ecmp", "final", src, dest, cost, hop);
+        }
+    }
+
+    template <class Table>
+    void dvrTables(const Table& dvr, uint32_t kind, int iteration) {
+        int width = dvr.blockWidth();
+        if (options.format == OutputFormat::Text) {
+            for (int i = 0; i < n; ++i) printDVRTable(i, dvr);
+            return;
+        }
+        if (options.format == OutputFormat::Binary) {
+            section(kind, iteration, 0, n, dvr.firstDest(), width);
+        }
+        const char* label = kind == table_file::DVR_FINAL ? "final" : nullptr;
+        for (int i = 0; i < n; ++i) {
+            for (int d = 0; d < width; ++d) {
+                entry("dvr", label, i, dvr.firstDest() + d, dvr.cost(i, d), dvr.nextHop(i, d), iteration);
+            }
+        }
+    }
+
+    void dvrDelta(const DvrEngine& dvr) {
+        if (options.format == OutputFormat::Text) {
+            append("Iteration ");
+            appendInt(dvr.rounds());
+            append(" changes:\nNode\tDest\tCost\tNext Hop\n");
+        } else if (options.format == OutputFormat::Binary) {
+            uint32_t count = 0;
+            dvr.forEachChange([&](int, int) { ++count; });
+            section(table_file::DVR_DELTA, dvr.rounds(), 0, count, dvr.firstDest(), 0);
+        }
+        dvr.forEachChange([&](int node, int d) {
+            int dest = dvr.firstDest() + d;
+            int cost = dvr.cost(node, d), hop = dvr.nextHop(node, d);
+            if (options.format == OutputFormat::Text) {
+                appendInt(node);
+                append("\t");
+                appendInt(dest);
+                append("\t");
+                appendCost(cost);
+                appendHop(hop);
+            } else if (options.format == OutputFormat::Binary) {
+                table_file::Change change{uint32_t(node), uint32_t(dest), cost == UNREACHABLE ? -1 : cost, hop};
+                raw(&change, sizeof(change));
+            } else {
+                entry("dvr", nullptr, node, dest, cost, hop, dvr.rounds());
+            }
+        });
+        if (options.format == OutputFormat::Text) append("\n");
+    }
+
+    template <class Table>
+    void printDVRTable(int node, const Table& dvr) {
+        append("Node ");
+        appendInt(node);
+        append(" Routing Table:\nDest\tCost\tNext Hop\n");
+        for (int d = 0; d < n; ++d) {
+            appendInt(d);
+            append("\t");
+            appendCost(dvr.cost(node, d));
+            appendHop(dvr.nextHop(node, d));
+        }
+        append("\n");
+    }
+
+    void printLSRTable(int src, const int* dist, const int* firstHop) {
+        append("Node ");
+        appendInt(src);
+        append(" Routing Table:\nDest\tCost\tNext Hop\n");
+        for (int i = 0; i < n; ++i) {
+            if (i == src) continue;
+            appendInt(i);
+            append("\t");
+            appendCost(dist[i]);
+            appendHop(firstHop[i]);
+        }
+        append("\n");
+    }
+
+    // One csv row or binary Entry. iterationLabel is used in csv instead of
+    // the number when given.
+    void entry(const char* table, const char* iterationLabel, int node, int dest, int cost, int hop,
+               int iteration = 0) {
+        if (cost == UNREACHABLE) cost = -1;
+        if (options.format == OutputFormat::Binary) {
+            table_file::Entry e{cost, hop};
+            raw(&e, sizeof(e));
+            return;
+        }
+        append(table);
+        append(",");
+        if (iterationLabel) append(iterationLabel);
+        else appendInt(iteration);
+        append(",");
+        appendInt(node);
+        append(",");
+        appendInt(dest);
+        append(",");
+        appendInt(cost);
+        append(",");
+        appendInt(hop);
+        append("\n");
+    }
+
+    void section(uint32_t kind, uint32_t iteration, uint32_t firstNode, uint32_t nodes, uint32_t firstDest,
+                 uint32_t dests) {
+        table_file::SectionHeader header{kind, iteration, firstNode, nodes, firstDest, dests};
+        raw(&header, sizeof(header));
+    }
+
+    void appendCost(int cost) {
+        appendInt(cost == UNREACHABLE ? INF : cost);
+        append("\t");
+    }
+    void appendHop(int hop) {
+        if (hop == -1) append("-\n");
+        else {
+            appendInt(hop);
+            append("\n");
+        }
+    }
+
+    void append(const char* s) { raw(s, std::strlen(s)); }
+    void appendInt(int value) {
+        char digits[16];
+        char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        raw(digits, end - digits);
+    }
+    void raw(const void* data, size_t size) {
+        buf.append(static_cast<const char*>(data), size);
+        if (buf.size() >= OUTPUT_BUFFER_SIZE) flush();
+    }
+    void flush() {
+        if (!buf.empty() && std::fwrite(buf.data(), 1, buf.size(), out) != buf.size()) {
+            std::cerr << "Error: write failed" << std::endl;
+            std::exit(1);
+        }
+        buf.clear();
+        std::fflush(out);
+    }
+
+    OutputOptions options;
+    int n;
+    FILE* out;
+    std::string buf;
+};
+
+#endif // ROUTING_OUTPUT_H
@@ -0,0 +1,127 @@
+// Compact all-pairs routing table.
+//
+// The engines work on int costs and next hops, 8 bytes per entry. A finished
+// table is only ever read, so RouteTable stores it as two flat arrays, costs
+// and next hops, each one row of n entries per source, 64-byte aligned, in
+// the narrowest unsigned type that holds them:
+//  - next hops take 2 bytes when n < 65535, else 4.
+//  - costs take 2 bytes when no path can cost 65535 or more, else 4. The
+//    bound comes from routeCostBound.
+// The largest value of each type marks an unreachable destination or a
+// missing next hop, so 50k nodes take 4 bytes an entry, 10 GB for the whole
+// table, instead of 20 GB as ints.
+//
+// Lookups are one index computation. A full path is rebuilt by following
+// next hops towards the destination, one lookup per hop.
+
+#ifndef ROUTING_ROUTE_TABLE_H
+#define ROUTING_ROUTE_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "graph.h"
+#include "lsr.h"
+
+class RouteTable {
+public:
+    // An empty table for n nodes whose path costs are all below costBound.
+    RouteTable(int n, int64_t costBound)
+        : n(n), wideCosts(costBound >= 0xFFFF), wideHops(n >= 0xFFFF),
+          costs(allocate(size_t(n) * n * (wideCosts ? 4 : 2))),
+          hops(allocate(size_t(n) * n * (wideHops ? 4 : 2))) {}
+    ~RouteTable() {
+        std::free(costs);
+        std::free(hops);
+    }
+    RouteTable(const RouteTable&) = delete;
+    RouteTable& operator=(const RouteTable&) = delete;
+
+    int size() const { return n; }
+    int costBytes() const { return wideCosts ? 4 : 2; }
+    int hopBytes() const { return wideHops ? 4 : 2; }
+    size_t bytes() const { return size_t(n) * n * (costBytes() + hopBytes()); }
+
+    // Stores the row of src from engine form: UNREACHABLE costs and -1 hops.
+    void setRow(int src, const int* dist, const int* firstHop) {
+        size_t row = size_t(src) * n;
+        if (wideCosts) narrow(static_cast<uint32_t*>(costs) + row, dist, UNREACHABLE);
+        else narrow(static_cast<uint16_t*>(costs) + row, dist, UNREACHABLE);
+        if (wideHops) narrow(static_cast<uint32_t*>(hops) + row, firstHop, -1);
+        else narrow(static_cast<uint16_t*>(hops) + row, firstHop, -1);
+    }
+
+    // Cost from src to dst, UNREACHABLE if there is no path.
+    int cost(int src, int dst) const {
+        size_t i = size_t(src) * n + dst;
+        uint32_t c = wideCosts ? static_cast<const uint32_t*>(costs)[i] : static_cast<const uint16_t*>(costs)[i];
+        return c == (wideCosts ? 0xFFFFFFFFu : 0xFFFFu) ? UNREACHABLE : int(c);
+    }
+    // Neighbour of src the route to dst leaves through, or -1.
+    int nextHop(int src, int dst) const {
+        size_t i = size_t(src) * n + dst;
+        uint32_t h = wideHops ? static_cast<const uint32_t*>(hops)[i] : static_cast<const uint16_t*>(hops)[i];
+        return h == (wideHops ? 0xFFFFFFFFu : 0xFFFFu) ? -1 : int(h);
+    }
+
+    // Nodes on the route from src to dst, both included; empty if there is
+    // none. Each hop's own table is followed, which for shortest-path tables
+    // lands on a path of the same cost.
+    std::vector<int> path(int src, int dst) const {
+        std::vector<int> nodes;
+        if (src != dst && nextHop(src, dst) == -1) return nodes;
+        nodes.push_back(src);
+        for (int u = src; u != dst && int(nodes.size()) <= n;) {
+            u = nextHop(u, dst);
+            if (u == -1) return {};
+            nodes.push_back(u);
+        }
+        return nodes;
+    }
+
+private:
+    static void* allocate(size_t bytes) {
+        void* p = std::aligned_alloc(64, (std::max<size_t>(bytes, 1) + 63) / 64 * 64);
+        if (!p) {
+            std::cerr << "Error: no memory for a " << bytes << "-byte routing table" << std::endl;
+            std::exit(1);
+        }
+        return p;
+    }
+
+    template <class T>
+    void narrow(T* out, const int* in, int missing) const {
+        for (int i = 0; i < n; ++i) out[i] = in[i] == missing ? T(~T(0)) : T(in[i]);
+    }
+
+    int n;
+    bool wideCosts;
+    bool wideHops;
+    void* costs;
+    void* hops;
+};
+
+// An upper bound on the cost of any path in g. Every route from u to v is no
+// dearer than going through node 0, so the two Dijkstras to and from node 0
+// bound them all. If node 0 does not reach everything both ways, it falls
+// back to the longest simple path possible: n - 1 of the dearest link.
+inline int64_t routeCostBound(const Graph& g) {
+    int maxLink = 0;
+    for (int c : g.costs) maxLink = std::max(maxLink, c);
+    int64_t bound = int64_t(std::max(g.n - 1, 0)) * maxLink;
+    if (g.n == 0) return bound;
+
+    std::vector<int> dist(g.n), hop(g.n);
+    LsrWorker worker;
+    int64_t outFar = 0, inFar = 0;
+    worker.run(g, 0, dist.data(), hop.data());
+    for (int d : dist) outFar = std::max<int64_t>(outFar, d);
+    worker.run(g.transpose(), 0, dist.data(), hop.data());
+    for (int d : dist) inFar = std::max<int64_t>(inFar, d);
+    if (outFar >= UNREACHABLE || inFar >= UNREACHABLE) return bound;
+    return std::min(bound, outFar + inFar);
+}
+
+#endif // ROUTING_ROUTE_TABLE_H
@@ -0,0 +1,205 @@
+// Benchmarks the DVR and LSR engines on generated topologies (topology.h) and
+// prints one CSV row per run:
+//   topology,nodes,links,algorithm,threads,tables,wall_ms,rounds,relaxations,
+//   relaxations_per_sec,peak_rss_kb
+// tables is the number of destinations DVR converged or of sources LSR ran.
+// Computing every table of a large topology takes O(n^2) time, so both are
+// sampled: DVR converges the first --dests destinations and LSR runs
+// --sources evenly spaced sources, 64 of each by default. rounds is the
+// number of DVR exchange rounds to convergence (empty for LSR). A relaxation
+// is one link scanned for one destination by DVR, or for one source by LSR.
+// peak_rss_kb is the peak resident memory during the run, graph included; on
+// kernels that cannot reset the peak it is the peak of the whole process so
+// far.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+#include "dvr.h"
+#include "graph.h"
+#include "lsr.h"
+#include "minplus.h"
+#include "thread_pool.h"
+#include "topology.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct RunStats {
+    double wallMs = 0;
+    int rounds = -1;  // -1 for LSR
+    int64_t relaxations = 0;
+    long peakKb = 0;
+};
+
+// Starts a new peak-memory measurement, if the kernel allows it.
+void resetPeakMemory() {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+long peakMemoryKb() {
+    long kb = 0;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) kb = atol(line + 6);
+        }
+        fclose(f);
+    }
+    if (kb == 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        kb = usage.ru_maxrss;
+    }
+    return kb;
+}
+
+// Converges DVR for destinations [0, dests), a block at a time.
+RunStats benchDVR(const Graph& graph, int dests) {
+    RunStats stats;
+    stats.rounds = 0;
+    Clock::time_point start = Clock::now();
+    int width = dvrBlockWidth(graph.n);
+    for (int first = 0; first < dests; first += width) {
+        DvrEngine dvr(graph, first, min(width, dests - first));
+        while (dvr.step()) {
+        }
+        stats.rounds = max(stats.rounds, dvr.rounds());
+        stats.relaxations += dvr.linkRelaxations() * dvr.blockWidth();
+    }
+    stats.wallMs = chrono::duration<double, milli>(Clock::now() - start).count();
+    return stats;
+}
+
+// Runs Dijkstra from `sources` evenly spaced sources across the pool. Results
+// are thrown away, so each thread reuses a single row.
+RunStats benchLSR(const Graph& graph, ThreadPool& pool, int sources) {
+    int n = graph.n;
+    RunStats stats;
+    vector<LsrWorker> workers(pool.size());
+    vector<vector<int>> dist(pool.size(), vector<int>(n)), firstHop(pool.size(), vector<int>(n));
+    vector<int64_t> scanned(pool.size() * 8);  // a cache line apart per worker
+    Clock::time_point start = Clock::now();
+    pool.parallelFor(sources, [&](int i, int w) {
+        int src = int(int64_t(i) * n / sources);
+        workers[w].run(graph, src, dist[w].data(), firstHop[w].data());
+        // Dijkstra scans the links of every node it reaches, once
+        int64_t links = 0;
+        for (int v = 0; v < n; ++v) {
+            if (dist[w][v] != UNREACHABLE) links += graph.degree(v);
+        }
+        scanned[w * 8] += links;
+    });
+    stats.wallMs = chrono::duration<double, milli>(Clock::now() - start).count();
+    for (int w = 0; w < pool.size(); ++w) stats.relaxations += scanned[w * 8];
+    return stats;
+}
+
+// Splits "a,b,c" into its parts.
+vector<string> splitList(const string& s) {
+    vector<string> parts;
+    stringstream in(s);
+    string part;
+    while (getline(in, part, ',')) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+const char* USAGE = " [--topology=random,grid,scalefree,fattree] [--nodes=1000,10000,...] [--degree=D]"
+                    " [--max-cost=C] [--seed=S] [--threads=N] [--dests=K] [--sources=K] [--repeat=R]"
+                    " [--algorithm=dvr,lsr] [--simd=auto|avx2|sse4.1|scalar]\n";
+
+int main(int argc, char *argv[]) {
+    vector<string> families = {"random", "grid", "scalefree", "fattree"};
+    vector<string> algorithms = {"dvr", "lsr"};
+    vector<int> sizes = {1000, 10000, 100000};
+    int degree = 8, maxCost = 10, threads = thread::hardware_concurrency(), repeat = 1;
+    int dests = 64, sources = 64;
+    uint64_t seed = 1;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (eq == string::npos || value.empty()) {
+            ok = false;
+        } else if (key == "--topology") {
+            families = splitList(value);
+        } else if (key == "--algorithm") {
+            algorithms = splitList(value);
+        } else if (key == "--nodes") {
+            sizes.clear();
+            for (const string& s : splitList(value)) sizes.push_back(stoi(s));
+        } else if (key == "--degree") {
+            degree = stoi(value);
+        } else if (key == "--max-cost") {
+            maxCost = stoi(value);
+        } else if (key == "--seed") {
+            seed = stoull(value);
+        } else if (key == "--threads") {
+            threads = stoi(value);
+        } else if (key == "--dests") {
+            dests = stoi(value);
+        } else if (key == "--sources") {
+            sources = stoi(value);
+        } else if (key == "--repeat") {
+            repeat = max(1, stoi(value));
+        } else if (key == "--simd") {
+            ok = minplus::select(value);
+        } else {
+            ok = false;
+        }
+    }
+    for (const string& a : algorithms) ok = ok && (a == "dvr" || a == "lsr");
+    if (!ok) {
+        cerr << "Usage: " << argv[0] << USAGE;
+        return 1;
+    }
+
+    ThreadPool pool(threads);
+    printf("topology,nodes,links,algorithm,threads,tables,wall_ms,rounds,relaxations,relaxations_per_sec,"
+           "peak_rss_kb\n");
+    for (const string& family : families) {
+        for (int size : sizes) {
+            // 1) Generate the topology
+            Graph graph = topology::generate(family, size, degree, maxCost, seed);
+            if (graph.n == 0) {
+                cerr << "Error: unknown topology " << family << endl;
+                return 1;
+            }
+            int n = graph.n;
+            for (const string& algorithm : algorithms) {
+                bool dvr = algorithm == "dvr";
+                int tables = min(dvr ? dests : sources, n);
+                // 2) Time each repeat and keep the fastest; the work done is the same every time
+                RunStats best;
+                for (int r = 0; r < repeat; ++r) {
+                    resetPeakMemory();
+                    RunStats stats = dvr ? benchDVR(graph, tables) : benchLSR(graph, pool, tables);
+                    stats.peakKb = peakMemoryKb();
+                    if (r == 0 || stats.wallMs < best.wallMs) best = stats;
+                }
+                // 3) One CSV row per run
+                double perSec = best.wallMs > 0 ? best.relaxations / (best.wallMs / 1000) : 0;
+                printf("%s,%d,%zu,%s,%d,%d,%.3f,", family.c_str(), n, graph.targets.size(), algorithm.c_str(),
+                       dvr ? 1 : pool.size(), tables, best.wallMs);
+                if (best.rounds >= 0) printf("%d", best.rounds);
+                printf(",%lld,%.0f,%ld\n", (long long)best.relaxations, perSec, best.peakKb);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
@@ -1,173 +1,455 @@
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <limits>
 #include <queue>
 #include <functional>
-#include <fstream>
-#include <sstream>
 #include <iomanip>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include "actors.h"
+#include "graph.h"
+#include "incremental.h"
+#include "dvr.h"
+#include "floyd_warshall.h"
+#include "loader.h"
+#include "lsr.h"
+#include "multipath.h"
+#include "output.h"
+#include "route_table.h"
+#include "thread_pool.h"
 
 using namespace std;
 
-const int INF = 9999;
+void simulateDVR(const Graph& graph, TableWriter& out) {
+    int n = graph.n;
+    // 1) Small topologies fit in one block; larger ones are converged one
+    //    block of destinations at a time, since the full tables do not fit
+    int width = dvrBlockWidth(n);
+    int maxRounds = 0;
+    int64_t relaxations = 0;
+    for (int first = 0; first < n; first += width) {
+        DvrEngine dvr(graph, first, min(width, n - first));
+        // 2) Exchange vectors until nothing changes, dumping each round
+        bool updated;
+        do {
+            updated = dvr.step();
+            out.dvrIteration(dvr);
+        } while (updated);
+        // 3) The stable (converged) tables
+        out.dvrFinal(dvr);
+        maxRounds = max(maxRounds, dvr.rounds());
+        relaxations += dvr.linkRelaxations();
+    }
+    if (width != n) {
+        out.note(to_string(n) + " nodes, " + to_string(graph.targets.size()) + " links, blocks of " +
+                 to_string(width) + " destinations, " + to_string(maxRounds) + " rounds, " +
+                 to_string(relaxations) + " link relaxations");
+    }
+}
+
+void simulateLSR(const Graph& graph, ThreadPool& pool, TableWriter& out) {
+    int n = graph.n;
+    // 1) Each thread reuses one worker (and its heap) for all of its sources
+    vector<LsrWorker> workers(pool.size());
+    // 2) Results for a batch of sources, one row of costs and first hops each
+    int batch = lsrBatchSize(n, pool.size());
+    vector<int> dist(size_t(batch) * n), firstHop(size_t(batch) * n);
 
-void printDVRTable(int node, const vector<vector<int>>& table, const vector<vector<int>>& nextHop) {
-    cout << "Node " << node << " Routing Table:\n";
-    cout << "Dest\tCost\tNext Hop\n";
-    for (int i = 0; i < table.size(); ++i) {
-        cout << i << "\t" << table[node][i] << "\t";
-        if (nextHop[node][i] == -1) cout << "-";
-        else cout << nextHop[node][i];
-        cout << endl;
+    for (int first = 0; first < n; first += batch) {
+        int count = min(batch, n - first);
+        // 3) Run Dijkstra for every source in the batch across the pool
+        pool.parallelFor(count, [&](int i, int w) {
+            workers[w].run(graph, first + i, &dist[size_t(i) * n], &firstHop[size_t(i) * n]);
+        });
+        // 4) Write the completed routing tables in source order
+        out.lsrTables(first, count, dist.data(), firstHop.data());
     }
-    cout << endl;
 }
 
-void simulateDVR(const vector<vector<int>>& graph) {
-    int n = graph.size();
-    // dist[i][j] will hold current best-known cost from i to j
-    vector<vector<int>> dist = graph;
-    // nextHop[i][j] stores the next hop node on the path from i to j
-    vector<vector<int>> nextHop(n, vector<int>(n, -1));
-
-    // 1) Initialization: for each direct neighbor j of node i, set nextHop[i][j] = j
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            if (graph[i][j] != INF && graph[i][j] != 0) {
-                nextHop[i][j] = j;
-            }
-        }
+// LSR with every equal-cost next hop instead of one (multipath.h).
+void simulateEcmp(const Graph& graph, ThreadPool& pool, TableWriter& out) {
+    int n = graph.n;
+    int words = ecmpWords(graph);
+    vector<EcmpWorker> workers(pool.size());
+    // 1) Batches sized like simulateLSR's, counting the wider next-hop sets
+    int batch = max(1, lsrBatchSize(n, pool.size()) * 2 / (1 + 2 * words));
+    vector<int> dist(size_t(batch) * n);
+    vector<uint64_t> hops(size_t(batch) * n * words);
+    for (int first = 0; first < n; first += batch) {
+        int count = min(batch, n - first);
+        pool.parallelFor(count, [&](int i, int w) {
+            workers[w].run(graph, first + i, &dist[size_t(i) * n], &hops[size_t(i) * n * words], words);
+        });
+        out.lsrEcmpTables(graph, first, count, dist.data(), hops.data(), words);
     }
+}
 
-    bool updated;
-    int iter = 0;
-    // 2) Iteratively exchange distance vectors until no changes occur
-    do {
-        updated = false;
-        iter++;
-        // Make copies of old tables to reference during this “round”
-        auto oldDist    = dist;
-        auto oldNextHop = nextHop;
-
-        // 3) For each node i, consider each reachable neighbor j
-        for (int i = 0; i < n; ++i) {
-            for (int j = 0; j < n; ++j) {
-                if (oldDist[i][j] == INF) continue;  // j not reachable from i
-                // 4) Try to improve paths to every destination k via neighbor j
-                for (int k = 0; k < n; ++k) {
-                    if (oldDist[j][k] == INF) continue;  // k not reachable from j
-                    int viaJ = oldDist[i][j] + oldDist[j][k];
-                    // 5) If going via j is cheaper, update cost and next hop
-                    if (dist[i][k] > viaJ) {
-                        dist[i][k]      = viaJ;
-                        nextHop[i][k]   = oldNextHop[i][j];
-                        updated         = true;
-                    }
-                }
-            }
+// Prints the k shortest loop-free paths for each (source, destination, k).
+void simulateKPaths(const Graph& graph, TableWriter& out, const vector<array<int, 3>>& queries) {
+    YenPaths yen(graph);
+    out.heading("K Shortest Paths");
+    for (const array<int, 3>& q : queries) {
+        vector<Path> paths = yen.find(q[0], q[1], q[2]);
+        out.report("Paths " + to_string(q[0]) + " -> " + to_string(q[1]) + ":" + (paths.empty() ? " unreachable" : ""));
+        for (size_t i = 0; i < paths.size(); ++i) {
+            ostringstream line;
+            line << "  " << i + 1 << ") cost " << paths[i].cost << ":";
+            for (int u : paths[i].nodes) line << " " << u;
+            out.report(line.str());
         }
+    }
+}
 
-        // 6) Print the routing table for each node after this iteration
-        cout << "Iteration " << iter << ":\n";
-        for (int i = 0; i < n; ++i) {
-            printDVRTable(i, dist, nextHop);
-        }
-    } while (updated);
+// Converges both protocols, then applies each link event in turn and reports
+// how long each took to reconverge and how many routing entries changed.
+// Whether a routing entry disagrees with Floyd-Warshall over the current
+// links: the cost must match, and the next hop must be a link that starts a
+// shortest path.
+bool wrongEntry(const FloydWarshall& fw, const LinkTable& links, int src, int dest, int cost, int hop) {
+    int expected = fw.cost(src, dest);
+    if (cost != expected) return true;
+    if (src == dest || expected == UNREACHABLE) return hop != -1;
+    if (hop < 0 || hop >= links.size()) return true;
+    int link = links.cost(src, hop);
+    return link == UNREACHABLE || link + fw.cost(hop, dest) != expected;
+}
 
-    // 7) Finally, print the stable (converged) tables
-    cout << "--- DVR Final Tables ---\n";
-    for (int i = 0; i < n; ++i) {
-        printDVRTable(i, dist, nextHop);
+template <class Table>
+int64_t wrongEntries(const FloydWarshall& fw, const LinkTable& links, const Table& table) {
+    int64_t wrong = 0;
+    for (int src = 0; src < links.size(); ++src) {
+        for (int dest = 0; dest < links.size(); ++dest) {
+            wrong += wrongEntry(fw, links, src, dest, table.cost(src, dest), table.nextHop(src, dest));
+        }
     }
+    return wrong;
 }
 
-void printLSRTable(int src, const vector<int>& dist, const vector<int>& prev) {
-    cout << "Node " << src << " Routing Table:\n";
-    cout << "Dest\tCost\tNext Hop\n";
-    for (int i = 0; i < dist.size(); ++i) {
-        if (i == src) continue;
-        cout << i << "\t" << dist[i] << "\t";
-        // Trace back from destination i to find the first hop after src
-        int hop = i;
-        while (prev[hop] != src && prev[hop] != -1) {
-            hop = prev[hop];
+// With check, both tables are compared with Floyd-Warshall after every event;
+// returns the number of wrong entries over all events (0 without check).
+int64_t simulateEvents(const Graph& graph, ThreadPool& pool, TableWriter& out, const vector<LinkEvent>& events,
+                       bool check) {
+    using Clock = chrono::steady_clock;
+    auto millis = [](Clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+    int n = graph.n;
+    if (dvrBlockWidth(n) != n) {
+        cerr << "Error: event mode needs the full tables in memory; " << n << " nodes is too many\n";
+        exit(1);
+    }
+
+    // 1) Initial tables, computed from scratch
+    LinkTable links(graph);
+    DvrNetwork dvr(graph, links);
+    IncrementalLsr lsr(graph, links, pool);
+
+    out.heading("Link Events");
+    int64_t wrong = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        const LinkEvent& e = events[i];
+        // 2) Change both directions of the link
+        int oldForward = links.cost(e.u, e.v), oldBackward = links.cost(e.v, e.u);
+        links.set(e.u, e.v, e.cost);
+        links.set(e.v, e.u, e.cost);
+
+        // 3) DVR: triggered updates from the two endpoints until quiet
+        Clock::time_point start = Clock::now();
+        DvrNetwork::Convergence dv = dvr.linksChanged({e.u, e.v});
+        double dvrMs = millis(Clock::now() - start);
+
+        // 4) LSR: repair every source's shortest-path tree
+        start = Clock::now();
+        int64_t lsChanged = lsr.linkChanged(e.u, e.v, oldForward) + lsr.linkChanged(e.v, e.u, oldBackward);
+        double lsrMs = millis(Clock::now() - start);
+
+        ostringstream line;
+        line << fixed << setprecision(3) << "Event " << i + 1 << ": " << e.kind << " " << e.u << " " << e.v;
+        if (e.kind != "down") line << " " << (e.cost == UNREACHABLE ? INF : e.cost);
+        line << " | DVR " << dv.rounds << " rounds, " << dv.changedEntries << " entries, " << dvrMs << " ms"
+             << " | LSR " << lsChanged << " entries, " << lsrMs << " ms";
+        if (check) {
+            // 5) Both against a from-scratch solution of the links as they are now
+            FloydWarshall fw(links.graph());
+            int64_t dvrWrong = wrongEntries(fw, links, dvr), lsrWrong = wrongEntries(fw, links, lsr);
+            line << " | wrong DVR " << dvrWrong << ", LSR " << lsrWrong;
+            wrong += dvrWrong + lsrWrong;
         }
-        if (prev[hop] == -1) cout << "-";
-        else             cout << hop;
-        cout << endl;
+        out.report(line.str());
     }
-    cout << endl;
+
+    // 6) The tables after the last event
+    out.heading("Distance Vector Routing Simulation");
+    out.dvrFinal(dvr);
+    out.heading("Link State Routing Simulation");
+    out.lsrTables(0, n, lsr.costs(), lsr.firstHops());
+    return wrong;
 }
 
-void simulateLSR(const vector<vector<int>>& graph) {
-    int n = graph.size();
-    // For each node as the source, run Dijkstra’s algorithm
-    for (int src = 0; src < n; ++src) {
-        // dist[v]: current best-known cost from src to v
-        vector<int>  dist(n, INF);
-        // prev[v]: the node immediately before v on the shortest path from src
-        vector<int>  prev(n, -1);
-        vector<bool> visited(n, false);
-
-        // 1) Distance to self is zero
-        dist[src] = 0;
-
-        // 2) Min‑heap of (distance, node) for selecting the next closest unvisited node
-        using P = pair<int,int>;
-        priority_queue<P, vector<P>, greater<P>> pq;
-        pq.push({0, src});
-
-        // 3) Main Dijkstra loop
-        while (!pq.empty()) {
-            auto [d, u] = pq.top(); pq.pop();
-            if (visited[u]) continue;      // Skip if already processed
-            visited[u] = true;
-
-            // 4) Relax every outgoing edge (u→v)
-            for (int v = 0; v < n; ++v) {
-                if (graph[u][v] == INF || graph[u][v] == 0) continue;
-                int cost = graph[u][v];
-                if (dist[v] > dist[u] + cost) {
-                    dist[v] = dist[u] + cost;
-                    prev[v] = u;
-                    pq.push({dist[v], v});
-                }
-            }
+// Runs DVR as routers exchanging messages (actors.h): a cold start, then each
+// link event, reporting the convergence time and traffic of each. With check,
+// the tables are compared with Floyd-Warshall after each; returns the number
+// of wrong entries over all of them (0 without check).
+int64_t simulateActors(const Graph& graph, ThreadPool& pool, TableWriter& out, const ActorOptions& options,
+                       const vector<LinkEvent>& events, bool check) {
+    using Clock = chrono::steady_clock;
+    int n = graph.n;
+    if (dvrBlockWidth(n) != n) {
+        cerr << "Error: --actors needs the full tables in memory; " << n << " nodes is too many\n";
+        exit(1);
+    }
+    LinkTable links(graph);
+    DvrActors actors(links, pool, options);
+    int64_t wrong = 0;
+    auto report = [&](const string& what, const DvrActors::Convergence& c, Clock::time_point start) {
+        ostringstream line;
+        line << fixed << setprecision(3) << what << " | time " << c.time << ", " << c.messages << " messages, "
+             << c.entries << " entries, " << c.routeChanges << " route changes, "
+             << chrono::duration<double, milli>(Clock::now() - start).count() << " ms";
+        if (check) {
+            FloydWarshall fw(links.graph());
+            int64_t entries = wrongEntries(fw, links, actors);
+            line << " | wrong " << entries;
+            wrong += entries;
         }
+        out.report(line.str());
+    };
 
-        // 5) Print the completed routing table for this source
-        printLSRTable(src, dist, prev);
+    out.heading(options.async ? "Message-Passing DVR (async)" : "Message-Passing DVR (sync)");
+    // 1) Every router starts out knowing only itself
+    Clock::time_point start = Clock::now();
+    report("Cold start", actors.start(), start);
+    for (size_t i = 0; i < events.size(); ++i) {
+        const LinkEvent& e = events[i];
+        // 2) Change both directions; the two endpoints react and the rest hear of it
+        start = Clock::now();
+        int oldForward = links.cost(e.u, e.v), oldBackward = links.cost(e.v, e.u);
+        links.set(e.u, e.v, e.cost);
+        links.set(e.v, e.u, e.cost);
+        actors.linkChanged(e.u, e.v, oldForward);
+        actors.linkChanged(e.v, e.u, oldBackward);
+        DvrActors::Convergence c = actors.converge();
+        ostringstream what;
+        what << "Event " << i + 1 << ": " << e.kind << " " << e.u << " " << e.v;
+        if (e.kind != "down") what << " " << (e.cost == UNREACHABLE ? INF : e.cost);
+        report(what.str(), c, start);
     }
+    // 3) The converged tables
+    out.dvrFinal(actors);
+    return wrong;
 }
 
-vector<vector<int>> readGraphFromFile(const string& filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Could not open file " << filename << endl;
+// Builds the all-pairs LSR tables into a compact RouteTable and answers each
+// (source, destination) query from it.
+void simulateRoutes(const Graph& graph, ThreadPool& pool, TableWriter& out, const vector<pair<int, int>>& routes) {
+    int n = graph.n;
+    // 1) Narrow costs when no path can overflow them
+    RouteTable table(n, routeCostBound(graph));
+    // 2) Dijkstra from every source; each thread narrows its own rows into the table
+    vector<LsrWorker> workers(pool.size());
+    vector<vector<int>> dist(pool.size(), vector<int>(n)), firstHop(pool.size(), vector<int>(n));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    pool.parallelFor(n, [&](int src, int w) {
+        workers[w].run(graph, src, dist[w].data(), firstHop[w].data());
+        table.setRow(src, dist[w].data(), firstHop[w].data());
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    out.heading("Routes");
+    ostringstream summary;
+    summary << fixed << setprecision(3) << "Route table: " << n << " nodes, " << table.costBytes()
+            << "-byte costs, " << table.hopBytes() << "-byte next hops, " << table.bytes() / double(1 << 20)
+            << " MiB, built in " << seconds << " s";
+    out.report(summary.str());
+    // 3) Each query is a lookup, and its path one lookup per hop
+    for (const pair<int, int>& r : routes) {
+        ostringstream line;
+        line << "Route " << r.first << " -> " << r.second << ": ";
+        vector<int> path = table.path(r.first, r.second);
+        if (path.empty()) {
+            line << "unreachable";
+        } else {
+            line << "cost " << table.cost(r.first, r.second) << ", path";
+            for (int u : path) line << " " << u;
+        }
+        out.report(line.str());
+    }
+}
+
+// Solves the topology with DVR, LSR and Floyd-Warshall and compares them
+// entry by entry (see wrongEntry). Returns the number of entries that fail.
+int64_t crossCheck(const Graph& graph, ThreadPool& pool, TableWriter& out) {
+    using Clock = chrono::steady_clock;
+    auto millis = [](Clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+    int n = graph.n;
+    if (dvrBlockWidth(n) != n) {
+        cerr << "Error: --check needs the full tables in memory; " << n << " nodes is too many\n";
         exit(1);
     }
-    int n; file >> n;
-    vector<vector<int>> graph(n, vector<int>(n));
-    for (int i = 0; i < n; ++i)
-        for (int j = 0; j < n; ++j)
-            file >> graph[i][j];
-    file.close();
-    return graph;
+    LinkTable links(graph);
+
+    // 1) Reference tables
+    Clock::time_point start = Clock::now();
+    FloydWarshall fw(graph);
+    double fwMs = millis(Clock::now() - start);
+
+    // 2) DVR, converged from scratch
+    start = Clock::now();
+    DvrEngine dvr(graph, 0, n);
+    while (dvr.step()) {
+    }
+    double dvrMs = millis(Clock::now() - start);
+    int64_t dvrWrong = wrongEntries(fw, links, dvr);
+
+    // 3) LSR, checked row by row as each source finishes
+    vector<LsrWorker> workers(pool.size());
+    vector<vector<int>> dist(pool.size(), vector<int>(n)), firstHop(pool.size(), vector<int>(n));
+    vector<int64_t> lsrWrong(pool.size() * 8);  // a cache line apart per worker
+    start = Clock::now();
+    pool.parallelFor(n, [&](int src, int w) {
+        workers[w].run(graph, src, dist[w].data(), firstHop[w].data());
+        for (int k = 0; k < n; ++k) lsrWrong[w * 8] += wrongEntry(fw, links, src, k, dist[w][k], firstHop[w][k]);
+    });
+    double lsrMs = millis(Clock::now() - start);
+    int64_t lsrTotal = 0;
+    for (int w = 0; w < pool.size(); ++w) lsrTotal += lsrWrong[w * 8];
+
+    out.heading("Cross-check");
+    ostringstream lines;
+    lines << fixed << setprecision(3) << "Floyd-Warshall (" << minplus::name() << "): " << fwMs << " ms\n"
+          << "DVR: " << dvr.rounds() << " rounds, " << dvrMs << " ms, " << dvrWrong << " wrong entries\n"
+          << "LSR: " << lsrMs << " ms, " << lsrTotal << " wrong entries";
+    out.report(lines.str());
+    return dvrWrong + lsrTotal;
 }
 
+const char* USAGE = " [--threads=N] [--output=text|csv|binary] [--iterations=full|delta|none]"
+                    " [--out=PATH] [--save-graph=PATH] [--events=FILE] [--route=SRC,DST ...] [--check]"
+                    " [--simd=auto|avx2|sse4.1|scalar] [--actors=sync|async] [--delay=D|MIN-MAX]"
+                    " [--poison=on|off] [--ecmp] [--k-paths=SRC,DST,K ...] <input_file>\n";
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <input_file>\n";
+    string filename;
+    int threads = thread::hardware_concurrency();
+    OutputOptions output;
+    string saveTo;
+    string eventsFile;
+    vector<pair<int, int>> routes;
+    bool check = false;
+    bool actors = false;
+    bool ecmp = false;
+    vector<array<int, 3>> kPaths;
+    ActorOptions actorOptions;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--threads") {
+            threads = stoi(value);
+        } else if (arg == "--output=text") {
+            output.format = OutputFormat::Text;
+        } else if (arg == "--output=csv") {
+            output.format = OutputFormat::Csv;
+        } else if (arg == "--output=binary") {
+            output.format = OutputFormat::Binary;
+        } else if (arg == "--iterations=full") {
+            output.iterations = IterationDump::Full;
+        } else if (arg == "--iterations=delta") {
+            output.iterations = IterationDump::Delta;
+        } else if (arg == "--iterations=none") {
+            output.iterations = IterationDump::None;
+        } else if (key == "--out") {
+            output.path = value;
+        } else if (key == "--save-graph") {
+            saveTo = value;
+        } else if (key == "--events") {
+            eventsFile = value;
+        } else if (key == "--route" && value.find(',') != string::npos) {
+            routes.push_back({stoi(value), stoi(value.substr(value.find(',') + 1))});
+        } else if (arg == "--actors=sync" || arg == "--actors=async") {
+            actors = true;
+            actorOptions.async = value == "async";
+        } else if (key == "--delay" && !value.empty()) {
+            size_t dash = value.find('-');
+            actorOptions.minDelay = stoi(value);
+            actorOptions.maxDelay = dash == string::npos ? actorOptions.minDelay : stoi(value.substr(dash + 1));
+            ok = actorOptions.minDelay >= 1 && actorOptions.maxDelay >= actorOptions.minDelay;
+        } else if (arg == "--poison=on" || arg == "--poison=off") {
+            actorOptions.poisonReverse = value == "on";
+        } else if (arg == "--ecmp") {
+            ecmp = true;
+        } else if (key == "--k-paths" && count(value.begin(), value.end(), ',') == 2) {
+            size_t a = value.find(','), b = value.find(',', a + 1);
+            kPaths.push_back({stoi(value), stoi(value.substr(a + 1)), stoi(value.substr(b + 1))});
+            ok = kPaths.back()[2] >= 1;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (key == "--simd") {
+            if (!minplus::select(value)) {
+                cerr << "Error: min-plus kernel " << value << " is not available on this CPU\n";
+                return 1;
+            }
+        } else if (filename.empty() && arg[0] != '-') {
+            filename = arg;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || filename.empty()) {
+        cerr << "Usage: " << argv[0] << USAGE;
         return 1;
     }
-    string filename = argv[1];
-    vector<vector<int>> graph = readGraphFromFile(filename);
+    Graph graph = loadGraph(filename);
+    if (!saveTo.empty()) {
+        // Convert the topology to binary CSR and stop
+        saveGraph(graph, saveTo);
+        return 0;
+    }
+    ThreadPool pool(threads);
+    TableWriter out(output, graph.n);
+    if (!kPaths.empty()) {
+        for (const array<int, 3>& q : kPaths) {
+            if (q[0] < 0 || q[0] >= graph.n || q[1] < 0 || q[1] >= graph.n) {
+                cerr << "Error: path query " << q[0] << "," << q[1] << " is out of range\n";
+                return 1;
+            }
+        }
+        simulateKPaths(graph, out, kPaths);
+        return 0;
+    }
+    if (actors) {
+        vector<LinkEvent> events = eventsFile.empty() ? vector<LinkEvent>() : loadEvents(eventsFile, graph.n);
+        return simulateActors(graph, pool, out, actorOptions, events, check) == 0 ? 0 : 1;
+    }
+    if (check && !eventsFile.empty()) {
+        return simulateEvents(graph, pool, out, loadEvents(eventsFile, graph.n), true) == 0 ? 0 : 1;
+    }
+    if (check) {
+        return crossCheck(graph, pool, out) == 0 ? 0 : 1;
+    }
+    if (!routes.empty()) {
+        for (const pair<int, int>& r : routes) {
+            if (r.first < 0 || r.first >= graph.n || r.second < 0 || r.second >= graph.n) {
+                cerr << "Error: route " << r.first << "," << r.second << " is out of range\n";
+                return 1;
+            }
+        }
+        simulateRoutes(graph, pool, out, routes);
+        return 0;
+    }
+    if (!eventsFile.empty()) {
+        simulateEvents(graph, pool, out, loadEvents(eventsFile, graph.n), false);
+        return 0;
+    }
 
-    cout << "\n--- Distance Vector Routing Simulation ---\n";
-    simulateDVR(graph);
+    out.heading("Distance Vector Routing Simulation");
+    simulateDVR(graph, out);
 
-    cout << "\n--- Link State Routing Simulation ---\n";
-    simulateLSR(graph);
+    out.heading("Link State Routing Simulation");
+    if (ecmp) simulateEcmp(graph, pool, out);
+    else simulateLSR(graph, pool, out);
 
     return 0;
 }
@@ -0,0 +1,112 @@
+// Fixed set of worker threads for running independent per-node work, such as
+// one Dijkstra per source, on every core.
+//
+// parallelFor splits the index range into one contiguous share per worker.
+// A worker claims indices from the front of its own share; once that is
+// empty it steals from the shares of the others, so a worker that drew cheap
+// items keeps helping until the whole range is done. Claiming is a single
+// fetch_add on the share's cursor, for owner and thief alike. The calling
+// thread works as worker 0, and the threads are kept between calls.
+
+#ifndef ROUTING_THREAD_POOL_H
+#define ROUTING_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) : shares(std::max(threads, 1)) {
+        for (int w = 1; w < size(); ++w) {
+            workers.emplace_back([this, w] { workerLoop(w); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    int size() const { return shares.size(); }
+
+    // Calls fn(i, worker) for every i in [0, count) and returns once all calls
+    // have finished. worker is in [0, size()) and identifies the calling
+    // thread, for indexing per-thread scratch state.
+    void parallelFor(int count, const std::function<void(int, int)>& fn) {
+        int per = count / size(), extra = count % size();
+        for (int w = 0, start = 0; w < size(); ++w) {
+            int len = per + (w < extra);
+            shares[w].next.store(start, std::memory_order_relaxed);
+            shares[w].end = start + len;
+            start += len;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            running = size() - 1;
+            ++generation;
+        }
+        wake.notify_all();
+        drain(0, fn);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return running == 0; });
+        job = nullptr;
+    }
+
+private:
+    struct alignas(64) Share {
+        std::atomic<int> next{0};
+        int end = 0;
+    };
+
+    void workerLoop(int w) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(int, int)>* fn;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                fn = job;
+            }
+            drain(w, *fn);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) done.notify_one();
+        }
+    }
+
+    // Works through the worker's own share, then steals from the others.
+    void drain(int w, const std::function<void(int, int)>& fn) {
+        for (int k = 0; k < size(); ++k) {
+            Share& share = shares[(w + k) % size()];
+            for (;;) {
+                int i = share.next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= share.end) break;
+                fn(i, w);
+            }
+        }
+    }
+
+    std::vector<Share> shares;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int, int)>* job = nullptr;
+    uint64_t generation = 0;
+    int running = 0;
+    bool stopping = false;
+};
+
+#endif // ROUTING_THREAD_POOL_H
@@ -0,0 +1,140 @@
+// Synthetic topologies for benchmarking.
+//
+// Four families, all with two-way links whose costs are drawn uniformly from
+// [1, maxCost] (a maxCost of 1 gives unit costs):
+//  - random: a random spanning tree, so the topology is connected, plus
+//    random extra links up to an average degree of `degree`.
+//  - grid: a near-square 2-D mesh, each node linked to the nodes beside it.
+//  - scalefree: Barabasi-Albert preferential attachment. Each new node links
+//    to degree / 2 existing nodes picked in proportion to their degree, which
+//    gives a few heavily linked hubs and many leaves.
+//  - fattree: the k-ary fat tree of data centre networks. Hosts hang off edge
+//    switches, each pod's edge and aggregation switches are fully linked, and
+//    aggregation switch i of every pod links to the i-th group of core switches.
+//    k is the smallest even number giving at least n nodes, so the node count
+//    is rounded up.
+// A topology depends only on its parameters and the seed.
+
+#ifndef ROUTING_TOPOLOGY_H
+#define ROUTING_TOPOLOGY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "graph.h"
+
+namespace topology {
+
+class LinkBuilder {
+public:
+    LinkBuilder(int maxCost, uint64_t seed) : rng(seed), cost(1, std::max(1, std::min(maxCost, INF - 1))) {}
+
+    // Adds a two-way link between u and v.
+    void link(int u, int v) {
+        int c = cost(rng);
+        edges.push_back({u, v, c});
+        edges.push_back({v, u, c});
+    }
+    int uniform(int count) { return std::uniform_int_distribution<int>(0, count - 1)(rng); }
+    Graph build(int n) const { return Graph::fromEdges(n, edges); }
+
+private:
+    std::mt19937_64 rng;
+    std::uniform_int_distribution<int> cost;
+    std::vector<Edge> edges;
+};
+
+inline Graph random(int n, int degree, int maxCost, uint64_t seed) {
+    LinkBuilder b(maxCost, seed);
+    // 1) Link every node to an earlier one, so all nodes are connected
+    for (int u = 1; u < n; ++u) b.link(u, b.uniform(u));
+    // 2) Extra links between random pairs; duplicates are merged in build
+    int64_t extra = int64_t(n) * degree / 2 - (n - 1);
+    for (int64_t i = 0; i < extra && n > 1; ++i) b.link(b.uniform(n), b.uniform(n));
+    return b.build(n);
+}
+
+inline Graph grid(int n, int maxCost, uint64_t seed) {
+    LinkBuilder b(maxCost, seed);
+    int cols = 1;
+    while (int64_t(cols) * cols < n) ++cols;
+    for (int u = 0; u < n; ++u) {
+        if ((u + 1) % cols != 0 && u + 1 < n) b.link(u, u + 1);
+        if (u + cols < n) b.link(u, u + cols);
+    }
+    return b.build(n);
+}
+
+inline Graph scaleFree(int n, int degree, int maxCost, uint64_t seed) {
+    LinkBuilder b(maxCost, seed);
+    int m = std::max(1, degree / 2);
+    // Both ends of every link so far; a uniform pick from it is a node picked
+    // in proportion to its degree
+    std::vector<int> ends;
+    // 1) A small clique to attach to
+    int core = std::min(n, m + 1);
+    for (int u = 0; u < core; ++u) {
+        for (int v = 0; v < u; ++v) {
+            b.link(u, v);
+            ends.push_back(u);
+            ends.push_back(v);
+        }
+    }
+    // 2) Every later node links to m distinct existing nodes
+    std::vector<int> picked;
+    for (int u = core; u < n; ++u) {
+        picked.clear();
+        while (int(picked.size()) < std::min(m, u)) {
+            int v = ends.empty() ? b.uniform(u) : ends[b.uniform(ends.size())];
+            if (std::find(picked.begin(), picked.end(), v) == picked.end()) picked.push_back(v);
+        }
+        for (int v : picked) {
+            b.link(u, v);
+            ends.push_back(u);
+            ends.push_back(v);
+        }
+    }
+    return b.build(n);
+}
+
+// Nodes in a k-ary fat tree: k^3/4 hosts, k^2/2 edge and aggregation
+// switches, and k^2/4 core switches.
+inline int64_t fatTreeSize(int k) { return int64_t(k) * k * k / 4 + int64_t(k) * k * 5 / 4; }
+
+inline Graph fatTree(int n, int maxCost, uint64_t seed) {
+    int k = 2;
+    while (fatTreeSize(k) < n) k += 2;
+    int half = k / 2;
+    LinkBuilder b(maxCost, seed);
+    // Core switches come first, then each pod's aggregation switches, edge
+    // switches and hosts
+    int cores = half * half;
+    int podSize = half + half + half * half;
+    for (int p = 0; p < k; ++p) {
+        int agg = cores + p * podSize, edge = agg + half, hosts = edge + half;
+        for (int i = 0; i < half; ++i) {
+            for (int j = 0; j < half; ++j) {
+                b.link(agg + i, i * half + j);
+                b.link(edge + i, agg + j);
+                b.link(hosts + i * half + j, edge + i);
+            }
+        }
+    }
+    return b.build(int(fatTreeSize(k)));
+}
+
+// Builds a topology by family name: random, grid, scalefree or fattree.
+// Returns an empty graph for an unknown name.
+inline Graph generate(const std::string& family, int n, int degree, int maxCost, uint64_t seed) {
+    if (family == "random") return random(n, degree, maxCost, seed);
+    if (family == "grid") return grid(n, maxCost, seed);
+    if (family == "scalefree") return scaleFree(n, degree, maxCost, seed);
+    if (family == "fattree") return fatTree(n, maxCost, seed);
+    return Graph();
+}
+
+} // namespace topology
+
+#endif // ROUTING_TOPOLOGY_H